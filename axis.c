@@ -39,13 +39,19 @@ chq_axis_new()
 	axis->label_padding = 4.0;
 	axis->label_slant = CAIRO_FONT_SLANT_NORMAL;
 	axis->label_weight = CAIRO_FONT_WEIGHT_BOLD;
+	axis->label_max_width = 0.0;
+	axis->label_max_height = 0.0;
 
 	axis->ticks_count = 0;
 	axis->ticks_positions = NULL;
 	axis->ticks_labels = NULL;
 
 	axis->orientation = ORIENTATION_HORIZONTAL;
+	axis->type = CHQ_AXIS_LINEAR;
 	axis->size = 0;
+	axis->limit_min = 0.0;
+	axis->limit_max = 1.0;
+	axis->label_cache = NULL;
 
 	return axis;
 }
@@ -76,35 +82,87 @@ chq_axis_vertical_new()
 
 
 /**
- * Destructor for chq_axis.
+ * Return a deep copy of an axis, including its ticks.
  */
-void
-chq_axis_kill(chq_axis_t *axis)
+chq_axis_t *
+chq_axis_copy(chq_axis_t *axis)
 {
-	int i;
+	chq_axis_t *copy = malloc(sizeof(chq_axis_t));
+	unsigned int i;
 
-	free(axis->label_fontfamily);
-	free(axis->ticks_positions);
+	*copy = *axis;
+	copy->label_fontfamily = strdup(axis->label_fontfamily);
+	copy->ticks_positions = malloc(sizeof(double) * axis->ticks_count);
+	copy->ticks_labels = calloc(axis->ticks_count, sizeof(char *));
+	copy->label_cache = NULL;
 
 	for (i = 0; i < axis->ticks_count; i++) {
-		free(axis->ticks_labels[i]);
+		copy->ticks_positions[i] = axis->ticks_positions[i];
+		if (axis->ticks_labels[i] != NULL)
+			copy->ticks_labels[i] = strdup(axis->ticks_labels[i]);
 	}
-	free(axis->ticks_labels);
+
+	return copy;
+}
+
+
+/**
+ * Destructor for chq_axis.
+ */
+void
+chq_axis_kill(chq_axis_t *axis)
+{
+	free(axis->label_fontfamily);
+	chq_axis_clear_ticks(axis);
+	chq_label_cache_kill(axis->label_cache);
 	free(axis);
 }
 
 
 /**
- * Set the limit, boundaries of an axis.
+ * Set the limit, boundaries of an axis. Limits that are not finite give
+ * 0 to 1, equal limits are widened so values can still be placed.
  */
 void
 chq_axis_set_limit(chq_axis_t *axis, double min, double max)
 {
+	double widen;
+
+	if (!isfinite(min) || !isfinite(max)) {
+		min = 0.0;
+		max = 1.0;
+	} else if (min == max) {
+		widen = fmax(1.0, fabs(min) * 1e-6);
+		min -= widen;
+		max += widen;
+	}
+
 	axis->limit_min = min;
 	axis->limit_max = max;
 }
 
 
+/**
+ * Set the font of the labels. Returns -1 if out of memory, the font is
+ * then unchanged.
+ */
+int
+chq_axis_set_label_font(chq_axis_t *axis, const char *family, double size)
+{
+	char *copy;
+
+	copy = strdup(family);
+	if (copy == NULL)
+		return -1;
+
+	free(axis->label_fontfamily);
+	axis->label_fontfamily = copy;
+	axis->label_fontsize = size;
+
+	return 0;
+}
+
+
 /**
  * Get the spread, essentially limit max minus limit min.
  */
@@ -121,23 +179,57 @@ chq_axis_get_spread(chq_axis_t *axis)
 void
 chq_axis_set_size(chq_axis_t *axis, double size)
 {
-	axis->size = size;
+	double count;
+
+	chq_axis_clear_ticks(axis);
+
+	/* Charts smaller than their margins have an empty plot. */
+	axis->size = size > 0.0 ? size : 0.0;
 
 	switch (axis->orientation) {
 	case ORIENTATION_VERTICAL:
-		axis->ticks_count = (size / (axis->label_padding * 2.0 +
+		count = (axis->size / (axis->label_padding * 2.0 +
 					axis->label_max_height)) / 2;
 		break;
 	case ORIENTATION_HORIZONTAL:
 	default:
-		axis->ticks_count = size / (axis->label_fontsize * 5.0);
+		/* Dates need more room than numbers. */
+		count = axis->size / (axis->label_fontsize *
+				(axis->type == CHQ_AXIS_TIME ? 8.0 : 5.0));
 		break;
 	}
+	axis->ticks_count = count >= 1.0 ? count : 0;
 
 	axis->ticks_positions = malloc(sizeof(double) * axis->ticks_count);
-	axis->ticks_labels = malloc(sizeof(char *) * axis->ticks_count);
-	axis->ticks_value_spacing = chq_axis_get_spread(axis) / 
-		(axis->ticks_count - 1);
+	axis->ticks_labels = calloc(axis->ticks_count, sizeof(char *));
+
+	/* A single tick sits on the lower limit. */
+	if (axis->ticks_count > 1)
+		axis->ticks_value_spacing = chq_axis_get_spread(axis) /
+			(axis->ticks_count - 1);
+	else
+		axis->ticks_value_spacing = 0.0;
+}
+
+
+/**
+ * Free the ticks of a previous sizing.
+ */
+void
+chq_axis_clear_ticks(chq_axis_t *axis)
+{
+	unsigned int i;
+
+	if (axis->ticks_labels != NULL) {
+		for (i = 0; i < axis->ticks_count; i++)
+			free(axis->ticks_labels[i]);
+	}
+	free(axis->ticks_labels);
+	free(axis->ticks_positions);
+
+	axis->ticks_count = 0;
+	axis->ticks_labels = NULL;
+	axis->ticks_positions = NULL;
 }
 
 
@@ -163,6 +255,33 @@ chq_axis_convert_to_scale(chq_axis_t *axis, double value)
 }
 
 
+/**
+ * Convert a chart coordinate on this axis back to a value, the inverse of
+ * chq_axis_convert_to_scale().
+ */
+double
+chq_axis_convert_from_scale(chq_axis_t *axis, double position)
+{
+	double spread = chq_axis_get_spread(axis);
+	double value_ratio;
+
+	if (axis->size <= 0.0)
+		return axis->limit_min;
+
+	switch (axis->orientation) {
+	case ORIENTATION_VERTICAL:
+		value_ratio = 1.0 - position / axis->size;
+		break;
+	case ORIENTATION_HORIZONTAL:
+	default:
+		value_ratio = position / axis->size;
+		break;
+	}
+
+	return axis->limit_min + value_ratio * spread;
+}
+
+
 /**
  * Set the label's font family on the provided cairo context.
  */
@@ -242,6 +361,11 @@ chq_axis_calculate_label_size(chq_axis_t *axis, cairo_t *cr)
 	double spacing;
 	double value;
 
+	if (axis->type == CHQ_AXIS_TIME) {
+		chq_axis_time_calculate_label_size(axis, cr);
+		return;
+	}
+
 	spacing = chq_axis_get_spread(axis) / (sample_max - 1);
 
 	for (i = 0; i < sample_max; i++) {
@@ -267,6 +391,10 @@ chq_axis_prerender_ticks(chq_axis_t *axis, cairo_t *cr)
 	unsigned int i;
 	char *rendered;
 
+	if (axis->type == CHQ_AXIS_TIME &&
+	    chq_axis_time_prerender_ticks(axis) == 0)
+		return;
+
 	for (i = 0; i < axis->ticks_count; i++) {
 		value = axis->limit_min +
 			(double)i * axis->ticks_value_spacing;
@@ -275,6 +403,7 @@ chq_axis_prerender_ticks(chq_axis_t *axis, cairo_t *cr)
 
 		axis->ticks_positions[i] = chq_axis_convert_to_scale(axis,
 				value);
+		free(axis->ticks_labels[i]);
 		axis->ticks_labels[i] = rendered;
 	}
 }
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Reference counted arrays of values. A buffer is never modified once
+ * created, so it can be shared by any number of charts, widgets and threads
+ * without copying; it is released when the last reference goes away.
+ *
+ * Only the copies made by chq_buffer_new() are private: the owner of memory
+ * wrapped in place may still write to it. So only those are scanned and
+ * flagged finite (no NaN nor infinity), letting the data pass skip its NaN
+ * checks.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chartesque.h"
+
+
+/**
+ * Constructor for a chq_buffer holding a copy of data, which may be NULL if
+ * len is 0. Returns NULL if the memory could not be allocated.
+ */
+chq_buffer_t *
+chq_buffer_new(const double *data, size_t len)
+{
+	double *copy;
+	chq_buffer_t *buffer;
+	size_t i;
+
+	copy = malloc(sizeof(double) * (len ? len : 1));
+	if (copy == NULL)
+		return NULL;
+	if (len > 0)
+		memcpy(copy, data, sizeof(double) * len);
+
+	buffer = chq_buffer_new_wrap(copy, CHQ_COLUMN_DOUBLE, len, free, copy);
+	if (buffer == NULL) {
+		free(copy);
+		return NULL;
+	}
+
+	buffer->finite = 1;
+	for (i = 0; i < len; i++) {
+		if (!isfinite(copy[i])) {
+			buffer->finite = 0;
+			break;
+		}
+	}
+
+	return buffer;
+}
+
+
+/**
+ * Constructor for a chq_buffer using len values of the given type in place.
+ * When the buffer is released, free_func is called with free_data, unless it
+ * is NULL (for memory the buffer will never outlive). Returns NULL if the
+ * buffer could not be allocated, in which case free_func is not called.
+ */
+chq_buffer_t *
+chq_buffer_new_wrap(void *data, enum column_type type, size_t len,
+		void (*free_func)(void *), void *free_data)
+{
+	chq_buffer_t *buffer = malloc(sizeof(chq_buffer_t));
+
+	if (buffer == NULL)
+		return NULL;
+
+	buffer->refcount = 1;
+	buffer->type = type;
+	buffer->data = data;
+	buffer->len = len;
+	/* Integers cannot be NaN, whoever writes them. */
+	buffer->finite = type == CHQ_COLUMN_INT64;
+	buffer->free_func = free_func;
+	buffer->free_data = free_data;
+
+	return buffer;
+}
+
+
+/**
+ * Take a new reference on a buffer, returns the buffer.
+ */
+chq_buffer_t *
+chq_buffer_ref(chq_buffer_t *buffer)
+{
+	__sync_add_and_fetch(&buffer->refcount, 1);
+
+	return buffer;
+}
+
+
+/**
+ * Drop a reference, releasing the buffer if it was the last one. NULL is
+ * accepted and ignored.
+ */
+void
+chq_buffer_unref(chq_buffer_t *buffer)
+{
+	if (buffer == NULL)
+		return;
+
+	if (__sync_sub_and_fetch(&buffer->refcount, 1) > 0)
+		return;
+
+	if (buffer->free_func != NULL)
+		buffer->free_func(buffer->free_data);
+	free(buffer);
+}
+
+
+/**
+ * Read the value at index of a column of the given type as a double.
+ */
+double
+chq_column_get(enum column_type type, const void *column, size_t index)
+{
+	switch (type) {
+	case CHQ_COLUMN_FLOAT:
+		return ((const float *)column)[index];
+	case CHQ_COLUMN_INT64:
+		return ((const int64_t *)column)[index];
+	case CHQ_COLUMN_DOUBLE:
+	default:
+		return ((const double *)column)[index];
+	}
+}
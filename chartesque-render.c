@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chartesque.h"
+
+static void	usage(void);
+static void	widen(double *, double *);
+static void	get_limits(double *, size_t, double *, double *);
+static int	has_suffix(const char *, const char *);
+static int	convert(chq_csv_t *, unsigned int, unsigned int, const char *,
+			const char *);
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: chartesque-render [-W width] [-H height] "
+	    "[--x column] [--y column]\n"
+	    "                         [--from x] [--to x] [--time] "
+	    "in.{csv,chq} out.{png,svg,pdf,chq}\n");
+	exit(1);
+}
+
+
+static int
+has_suffix(const char *s, const char *suffix)
+{
+	size_t len = strlen(s), suffix_len = strlen(suffix);
+
+	return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+
+/**
+ * Make boundaries drawable: 0 to 1 if there was no value, around the value
+ * if there was a single one.
+ */
+static void
+widen(double *min, double *max)
+{
+	if (*min > *max) {
+		*min = 0.0;
+		*max = 1.0;
+	} else if (*min == *max) {
+		*min -= 1.0;
+		*max += 1.0;
+	}
+}
+
+
+/**
+ * Find the boundaries of a column, ignoring the fields that did not parse.
+ */
+static void
+get_limits(double *data, size_t len, double *min, double *max)
+{
+	size_t i;
+
+	*min = INFINITY;
+	*max = -INFINITY;
+
+	for (i = 0; i < len; i++) {
+		if (data[i] < *min)
+			*min = data[i];
+		if (data[i] > *max)
+			*max = data[i];
+	}
+
+	widen(min, max);
+}
+
+
+/**
+ * Convert two columns of a CSV file to a series file at path, one chunk at
+ * a time so files larger than memory can be converted. Returns the exit
+ * status.
+ */
+static int
+convert(chq_csv_t *csv, unsigned int x_col, unsigned int y_col,
+		const char *csv_path, const char *path)
+{
+	chq_store_writer_t *writer = NULL;
+	double *data_x, *data_y;
+	size_t rows, offset = 0;
+	int error = 0;
+
+	data_x = malloc(sizeof(double) * CHQ_STORE_CHUNK_ROWS);
+	data_y = malloc(sizeof(double) * CHQ_STORE_CHUNK_ROWS);
+	if (data_x == NULL || data_y == NULL) {
+		perror("malloc");
+		free(data_x);
+		free(data_y);
+		return 1;
+	}
+
+	while ((rows = chq_csv_stream(csv, x_col, y_col, data_x, data_y,
+	    CHQ_STORE_CHUNK_ROWS, &offset)) > 0) {
+		if (writer == NULL) {
+			writer = chq_store_writer_new(path, 0);
+			if (writer == NULL) {
+				error = 1;
+				break;
+			}
+		}
+		if (chq_store_writer_append(writer, data_x, data_y, rows) == -1)
+			break;
+	}
+
+	free(data_x);
+	free(data_y);
+
+	if (writer == NULL && !error) {
+		fprintf(stderr, "chartesque-render: no data in %s\n", csv_path);
+		return 1;
+	}
+	if (error || chq_store_writer_close(writer) == -1) {
+		perror(path);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	static struct option longopts[] = {
+		{ "x",		required_argument,	NULL,	'x' },
+		{ "y",		required_argument,	NULL,	'y' },
+		{ "width",	required_argument,	NULL,	'W' },
+		{ "height",	required_argument,	NULL,	'H' },
+		{ "from",	required_argument,	NULL,	'f' },
+		{ "to",		required_argument,	NULL,	't' },
+		{ "time",	no_argument,		NULL,	'T' },
+		{ NULL,		0,			NULL,	0 }
+	};
+	const char *x_name = "1", *y_name = "2";
+	unsigned int width = 800, height = 600;
+	double *data_x = NULL, *data_y = NULL, min, max, y_min, y_max;
+	double from = NAN, to = NAN;
+	int ch, x_col, y_col, error, time_axis = 0;
+	size_t data_len;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	chq_dataplot_t *chart;
+	chq_store_t *store = NULL;
+	chq_csv_t *csv;
+
+	while ((ch = getopt_long(argc, argv, "x:y:W:H:f:t:T", longopts, NULL))
+	    != -1) {
+		switch (ch) {
+		case 'x':
+			x_name = optarg;
+			break;
+		case 'y':
+			y_name = optarg;
+			break;
+		case 'W':
+			width = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			height = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			from = strtod(optarg, NULL);
+			break;
+		case 't':
+			to = strtod(optarg, NULL);
+			break;
+		case 'T':
+			time_axis = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2 || width == 0 || height == 0)
+		usage();
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, width);
+	chq_dataplot_set_height(chart, height);
+	if (time_axis)
+		chq_axis_set_type(chart->x_axis, CHQ_AXIS_TIME);
+
+	if (has_suffix(argv[0], ".chq")) {
+		store = chq_store_open(argv[0]);
+		if (store == NULL) {
+			fprintf(stderr, "chartesque-render: cannot read %s\n",
+			    argv[0]);
+			return 1;
+		}
+		chq_dataplot_set_store(chart, store);
+		chq_store_get_limits(store, &min, &max, &y_min, &y_max);
+		widen(&min, &max);
+		widen(&y_min, &y_max);
+	} else {
+		csv = chq_csv_open(argv[0]);
+		if (csv == NULL) {
+			perror(argv[0]);
+			return 1;
+		}
+
+		x_col = chq_csv_get_column(csv, x_name);
+		y_col = chq_csv_get_column(csv, y_name);
+		if (x_col == -1 || y_col == -1) {
+			fprintf(stderr, "chartesque-render: no such column: "
+			    "%s\n", x_col == -1 ? x_name : y_name);
+			return 1;
+		}
+
+		/* Conversion to a series file, nothing to draw. */
+		if (has_suffix(argv[1], ".chq")) {
+			error = convert(csv, x_col, y_col, argv[0], argv[1]);
+			chq_csv_kill(csv);
+			return error;
+		}
+
+		data_len = chq_csv_read_columns(csv, x_col, y_col, &data_x,
+				&data_y);
+		chq_csv_kill(csv);
+		if (data_len == 0) {
+			fprintf(stderr, "chartesque-render: no data in %s\n",
+			    argv[0]);
+			return 1;
+		}
+
+		chq_dataplot_set_data(chart, data_x, data_y, data_len);
+		get_limits(data_x, data_len, &min, &max);
+		get_limits(data_y, data_len, &y_min, &y_max);
+	}
+
+	if (!isnan(from))
+		min = from;
+	if (!isnan(to))
+		max = to;
+	if (!(min < max) || !(y_min < y_max)) {
+		fprintf(stderr, "chartesque-render: empty range\n");
+		return 1;
+	}
+	chq_axis_set_limit(chart->x_axis, min, max);
+	chq_axis_set_limit(chart->y_axis, y_min, y_max);
+
+	if (has_suffix(argv[1], ".svg")) {
+		error = chq_dataplot_render_svg(chart, argv[1]);
+	} else if (has_suffix(argv[1], ".pdf")) {
+		error = chq_dataplot_render_pdf(chart, argv[1]);
+	} else {
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				width, height);
+		cr = cairo_create(surface);
+		chq_dataplot_render(chart, cr);
+		error = cairo_surface_write_to_png(surface, argv[1]) !=
+		    CAIRO_STATUS_SUCCESS;
+		cairo_destroy(cr);
+		cairo_surface_destroy(surface);
+	}
+
+	if (error) {
+		fprintf(stderr, "chartesque-render: cannot write %s\n",
+		    argv[1]);
+		return 1;
+	}
+
+	chq_dataplot_kill(chart);
+	if (store != NULL)
+		chq_store_kill(store);
+	free(data_x);
+	free(data_y);
+
+	return 0;
+}
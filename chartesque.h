@@ -14,22 +14,73 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifndef _CHARTESQUE_H_
+#define _CHARTESQUE_H_
+
 #include <cairo.h>
 #ifndef CAIRO_HAS_PNG_FUNCTIONS
 #error This program requires cairo with PNG support
 #endif
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #define MAX_LABEL_SIZE	64
 
+/* Number of labels a time axis keeps between renders. */
+#define CHQ_LABEL_CACHE_SIZE	128
+#define CHQ_TIME_FIELDS		5
+
+/* Default number of rows per chunk of series files. */
+#define CHQ_STORE_CHUNK_ROWS	65536
+
+enum render_status {
+	CHQ_RENDER_DONE = 0,
+	CHQ_RENDER_MORE = 1
+};
+
+enum overlay_type {
+	CHQ_OVERLAY_ENVELOPE = 0,
+	CHQ_OVERLAY_MEAN = 1,
+	CHQ_OVERLAY_PERCENTILES = 2
+};
+
+enum axis_type {
+	CHQ_AXIS_LINEAR = 0,
+	CHQ_AXIS_TIME = 1
+};
+
 enum orientation {
 	ORIENTATION_HORIZONTAL = 0,
 	ORIENTATION_VERTICAL = 1
 };
 
+/* Type of the values of a data column. */
+enum column_type {
+	CHQ_COLUMN_DOUBLE = 0,
+	CHQ_COLUMN_FLOAT = 1,
+	CHQ_COLUMN_INT64 = 2
+};
+
+#define CHQ_COLUMN_TYPES	3
+
+typedef struct _chq_label_cache_t {
+	/* labels of the current step */
+	int			 step;
+	unsigned int		 len;
+	double			 values[CHQ_LABEL_CACHE_SIZE];
+	char			*labels[CHQ_LABEL_CACHE_SIZE];
+	/* size of a complete label per finest field, for this font */
+	char			*font_family;
+	double			 font_size;
+	double			 label_widths[CHQ_TIME_FIELDS];
+	double			 label_height;
+} chq_label_cache_t;
+
 typedef struct _chq_axis_t {
 	enum orientation	 orientation;
+	enum axis_type		 type;
 	double			 size;
 	double			 limit_min;
 	double			 limit_max;
@@ -47,8 +98,148 @@ typedef struct _chq_axis_t {
 	double			*ticks_positions;
 	char			**ticks_labels;
 	double			 ticks_value_spacing;
+	chq_label_cache_t	*label_cache;
 } chq_axis_t;
 
+typedef struct _chq_buffer_t {
+	volatile int	 refcount;
+	enum column_type type;
+	void		*data;
+	size_t		 len;
+	/* 1 if the values cannot change and are all finite */
+	int		 finite;
+	void		(*free_func)(void *);
+	void		*free_data;
+} chq_buffer_t;
+
+typedef struct _chq_reduce_t {
+	double		 resolution;
+	double		 precision;
+	/* reduced points */
+	size_t		 len;
+	size_t		 size;
+	double		*x;
+	double		*y;
+	/* column being accumulated */
+	int		 open;
+	double		 column;
+	size_t		 count;
+	double		 first_x, first_y;
+	double		 min_x, min_y;
+	double		 max_x, max_y;
+	double		 last_x, last_y;
+	size_t		 min_seq, max_seq;
+} chq_reduce_t;
+
+typedef struct _chq_raster_t {
+	cairo_surface_t	*surface;
+	unsigned char	*data;
+	int		 width;
+	int		 height;
+	int		 stride;
+	/* pixels drawn, in [clip_x0, clip_x1) x [clip_y0, clip_y1) */
+	int		 clip_x0, clip_y0;
+	int		 clip_x1, clip_y1;
+} chq_raster_t;
+
+typedef struct _chq_pool_entry_t {
+	cairo_surface_t	*surface;
+	cairo_t		*cr;
+	cairo_format_t	 format;
+	int		 width;
+	int		 height;
+	int		 busy;
+	unsigned long	 used;
+} chq_pool_entry_t;
+
+typedef struct _chq_pool_t {
+	unsigned int	  size;
+	unsigned long	  clock;
+	chq_pool_entry_t *entries;
+} chq_pool_t;
+
+typedef struct _chq_pick_t {
+	/* what the index was built for */
+	const void	*data_x;
+	const void	*data_y;
+	size_t		 data_len;
+	double		 x_size, y_size;
+	double		 x_min, x_max;
+	double		 y_min, y_max;
+	/* index */
+	int		 sorted;
+	int		 grid_width;
+	int		 grid_height;
+	size_t		*grid;
+} chq_pick_t;
+
+struct chq_overlay_cursor {
+	unsigned int	 bin;
+	size_t		 below;
+};
+
+typedef struct _chq_overlay_t {
+	enum overlay_type	 type;
+	size_t			 window;
+	double			 lower_q, upper_q;
+	/* last window values, by sequence number */
+	double			*values;
+	size_t			 count;
+	size_t			 seq;
+	double			 sum;
+	/* monotonic deques of sequence numbers, for the envelope */
+	size_t			*min_deque;
+	size_t			 min_head, min_len;
+	size_t			*max_deque;
+	size_t			 max_head, max_len;
+	/* histogram of the window, for the percentiles */
+	unsigned int		*histogram;
+	unsigned int		 bins;
+	double			 bin_top;
+	double			 bin_size;
+	struct chq_overlay_cursor lower_cursor, upper_cursor;
+	/* output, upper alone for lines */
+	chq_reduce_t		*upper;
+	chq_reduce_t		*lower;
+	chq_reduce_t		*shown_upper;
+	chq_reduce_t		*shown_lower;
+	chq_reduce_t		*outline;
+	struct _chq_overlay_t	*next;
+} chq_overlay_t;
+
+struct chq_store_chunk;
+
+typedef struct _chq_store_t {
+	int		 fd;
+	char		*map;
+	size_t		 map_len;
+	uint64_t	 rows;
+	uint32_t	 chunk_rows;
+	uint64_t	 chunks_count;
+	const struct chq_store_chunk *chunks;
+	/* decoded X values of the current chunk */
+	double		*scratch;
+	/* serve the chunks within one column from their zone map */
+	int		 stats;
+} chq_store_t;
+
+typedef struct _chq_store_writer_t {
+	FILE		*fp;
+	char		*path;
+	uint32_t	 chunk_rows;
+	uint64_t	 rows;
+	uint64_t	 offset;
+	int		 error;
+	/* directory, written last */
+	struct chq_store_chunk *chunks;
+	size_t		 chunks_count;
+	size_t		 chunks_size;
+	/* rows of the chunk being filled */
+	double		*x;
+	double		*y;
+	size_t		 pending;
+} chq_store_writer_t;
+
 typedef struct _chq_dataplot_t {
 	cairo_t		*cr;
 	unsigned int	 width;
@@ -63,10 +254,89 @@ typedef struct _chq_dataplot_t {
 	double		 margin_left;
 	/* data */
 	size_t		 data_len;
-	double		*data_x;
-	double		*data_y;
+	const void	*data_x;
+	const void	*data_y;
+	enum column_type type_x;
+	enum column_type type_y;
+	chq_buffer_t	*buffer_x;
+	chq_buffer_t	*buffer_y;
+	chq_store_t	*store;
+	/* output */
+	chq_reduce_t	*reduce;
+	chq_reduce_t	*preview;
+	size_t		 progress;
+	double		 precision;
+	int		 labels_as_text;
+	int		 fast_raster;
+	/* polled during the data pass */
+	int		(*cancel)(void *);
+	void		*cancel_data;
+	/* hit-testing index, built on demand */
+	chq_pick_t	*pick;
+	/* rolling statistics, drawn with the data */
+	chq_overlay_t	*overlays;
 } chq_dataplot_t;
 
+typedef struct _chq_kernel_t {
+	const char	*name;
+	/* device coordinates are value * scale + offset */
+	double		 x_scale, x_offset;
+	double		 y_scale, y_offset;
+	chq_overlay_t	*overlays;
+	size_t		(*run)(const struct _chq_kernel_t *, chq_reduce_t *,
+			    const void *, const void *, size_t, size_t, size_t);
+} chq_kernel_t;
+
+typedef struct _chq_layout_t {
+	unsigned int	 width;
+	unsigned int	 height;
+	double		 margin_top;
+	double		 margin_right;
+	double		 margin_bottom;
+	double		 margin_left;
+	/* prepared copies of the template's axes */
+	chq_axis_t	*x_axis;
+	chq_axis_t	*y_axis;
+	/* plot area */
+	double		 plot_left;
+	double		 plot_top;
+	double		 plot_width;
+	double		 plot_height;
+	/* pre-rendered axes, NULL for non-image targets */
+	cairo_surface_t	*frame;
+} chq_layout_t;
+
+typedef struct _chq_grid_t {
+	unsigned int	 width;
+	unsigned int	 height;
+	unsigned int	 columns;
+	unsigned int	 rows;
+	unsigned int	 spacing;
+	/* borrowed charts, row by row, NULL for empty cells */
+	chq_dataplot_t	**cells;
+	/* limits and fonts of the shared axes */
+	chq_axis_t	*x_axis;
+	chq_axis_t	*y_axis;
+	int		 share_x;
+	int		 share_y;
+	int		 labels_as_text;
+	/* threads drawing the cells, 0 for one per CPU */
+	unsigned int	 threads;
+} chq_grid_t;
+
+typedef struct _chq_csv_t {
+	int		 fd;
+	char		*map;
+	size_t		 map_len;
+	char		 delimiter;
+	/* columns, names are NULL if the file has no header */
+	unsigned int	 columns_count;
+	char		**columns_names;
+	/* rows, after the header line */
+	const char	*body;
+	size_t		 body_len;
+} chq_csv_t;
+
 
 /* strlcpy.c */
 size_t		 strlcpy(char *, const char *, size_t);
@@ -75,11 +345,15 @@ size_t		 strlcpy(char *, const char *, size_t);
 chq_axis_t 	*chq_axis_new(void);
 chq_axis_t 	*chq_axis_horizontal_new(void);
 chq_axis_t 	*chq_axis_vertical_new(void);
+chq_axis_t	*chq_axis_copy(chq_axis_t *);
 void		 chq_axis_kill(chq_axis_t *);
 void		 chq_axis_set_limit(chq_axis_t *, double, double);
+int		 chq_axis_set_label_font(chq_axis_t *, const char *, double);
 double		 chq_axis_get_spread(chq_axis_t *);
 void		 chq_axis_set_size(chq_axis_t *, double);
+void		 chq_axis_clear_ticks(chq_axis_t *);
 double		 chq_axis_convert_to_scale(chq_axis_t *, double);
+double		 chq_axis_convert_from_scale(chq_axis_t *, double);
 void		 chq_axis_select_label_fontfamily(chq_axis_t *, cairo_t *);
 double		 chq_axis_vertical_get_width(chq_axis_t *);
 double		 chq_axis_horizontal_get_height(chq_axis_t *);
@@ -88,6 +362,28 @@ char 		*chq_axis_prerender_value(chq_axis_t *, cairo_t *, double,
 void		 chq_axis_calculate_label_size(chq_axis_t *, cairo_t *);
 void		 chq_axis_prerender_ticks(chq_axis_t *, cairo_t *);
 
+/* kernel.c */
+void		 chq_kernel_setup(chq_kernel_t *, chq_dataplot_t *,
+			chq_overlay_t *, enum column_type, enum column_type,
+			int);
+
+/* grid.c */
+chq_grid_t	*chq_grid_new(unsigned int, unsigned int);
+void		 chq_grid_kill(chq_grid_t *);
+void		 chq_grid_set_size(chq_grid_t *, unsigned int, unsigned int);
+void		 chq_grid_set_cell(chq_grid_t *, unsigned int, unsigned int,
+			chq_dataplot_t *);
+void		 chq_grid_set_shared(chq_grid_t *, int, int);
+void		 chq_grid_render(chq_grid_t *, cairo_t *);
+int		 chq_grid_render_to_buffer(chq_grid_t *, uint8_t *, int,
+			cairo_format_t);
+
+/* timeaxis.c */
+void		 chq_label_cache_kill(chq_label_cache_t *);
+void		 chq_axis_set_type(chq_axis_t *, enum axis_type);
+void		 chq_axis_time_calculate_label_size(chq_axis_t *, cairo_t *);
+int		 chq_axis_time_prerender_ticks(chq_axis_t *);
+
 /* dataplot.c */
 chq_dataplot_t 	*chq_dataplot_new(void);
 void		 chq_dataplot_kill(chq_dataplot_t *);
@@ -102,8 +398,117 @@ void		 chq_dataplot_render_x_label_text(chq_dataplot_t *, double,
 void		 chq_dataplot_render_y_label_value(chq_dataplot_t *, double);
 void		 chq_dataplot_render_y_axis_labels(chq_dataplot_t *);
 void		 chq_dataplot_render_x_axis_labels(chq_dataplot_t *);
+void		 chq_dataplot_prepare_axes(chq_dataplot_t *);
+void		 chq_dataplot_draw_axes(chq_dataplot_t *);
 void		 chq_dataplot_render_axes(chq_dataplot_t *);
+void		 chq_dataplot_reduce_begin(chq_dataplot_t *, chq_reduce_t *);
+int		 chq_dataplot_reduce_array(chq_dataplot_t *, chq_reduce_t *,
+			const double *, const double *, size_t, size_t, size_t);
+int		 chq_dataplot_reduce_range(chq_dataplot_t *, chq_reduce_t *,
+			size_t, size_t, size_t);
+void		 chq_dataplot_draw_reduced(chq_dataplot_t *, chq_reduce_t *);
+void		 chq_dataplot_render_plots(chq_dataplot_t *);
 void		 chq_dataplot_render(chq_dataplot_t *, cairo_t *);
+int		 chq_dataplot_render_progressive(chq_dataplot_t *, cairo_t *,
+			double);
+void		 chq_dataplot_restart(chq_dataplot_t *);
+int		 chq_dataplot_render_to_buffer(chq_dataplot_t *, uint8_t *,
+			int, cairo_format_t);
 void		 chq_dataplot_set_width(chq_dataplot_t *, unsigned int);
 void		 chq_dataplot_set_height(chq_dataplot_t *, unsigned int);
 void		 chq_dataplot_set_output_file(chq_dataplot_t *, char *);
+void		 chq_dataplot_set_data(chq_dataplot_t *, double *, double *,
+			size_t);
+void		 chq_dataplot_set_buffers(chq_dataplot_t *, chq_buffer_t *,
+			chq_buffer_t *);
+void		 chq_dataplot_set_fast_raster(chq_dataplot_t *, int);
+void		 chq_dataplot_set_cancel(chq_dataplot_t *, int (*)(void *),
+			void *);
+
+/* buffer.c */
+chq_buffer_t	*chq_buffer_new(const double *, size_t);
+chq_buffer_t	*chq_buffer_new_wrap(void *, enum column_type, size_t,
+			void (*)(void *), void *);
+chq_buffer_t	*chq_buffer_ref(chq_buffer_t *);
+void		 chq_buffer_unref(chq_buffer_t *);
+double		 chq_column_get(enum column_type, const void *, size_t);
+
+/* reduce.c */
+chq_reduce_t	*chq_reduce_new(void);
+void		 chq_reduce_kill(chq_reduce_t *);
+void		 chq_reduce_reset(chq_reduce_t *, double, double);
+void		 chq_reduce_copy(chq_reduce_t *, chq_reduce_t *);
+void		 chq_reduce_push(chq_reduce_t *, double, double);
+void		 chq_reduce_flush(chq_reduce_t *);
+
+/* raster.c */
+int		 chq_raster_init(chq_raster_t *, cairo_t *);
+void		 chq_raster_done(chq_raster_t *);
+void		 chq_raster_clip(chq_raster_t *, double, double, double,
+			double);
+void		 chq_raster_fill(chq_raster_t *, chq_reduce_t *, double, double,
+			double);
+void		 chq_raster_stroke(chq_raster_t *, chq_reduce_t *, double,
+			double, double, double);
+
+/* layout.c */
+chq_layout_t	*chq_layout_new(chq_dataplot_t *, cairo_t *);
+void		 chq_layout_kill(chq_layout_t *);
+void		 chq_dataplot_render_layout(chq_dataplot_t *, chq_layout_t *,
+			cairo_t *);
+
+/* pick.c */
+void		 chq_pick_kill(chq_pick_t *);
+void		 chq_dataplot_pick_prepare(chq_dataplot_t *);
+int		 chq_dataplot_pick(chq_dataplot_t *, double, double, double,
+			size_t *);
+
+/* overlay.c */
+chq_overlay_t	*chq_overlay_new(enum overlay_type, size_t);
+void		 chq_overlay_kill(chq_overlay_t *);
+void		 chq_overlay_set_percentiles(chq_overlay_t *, double, double);
+void		 chq_overlay_begin(chq_overlay_t *, double, double, double,
+			double);
+void		 chq_overlay_push(chq_overlay_t *, double, double);
+void		 chq_overlay_snapshot(chq_overlay_t *);
+chq_overlay_t	*chq_dataplot_add_overlay(chq_dataplot_t *, enum overlay_type,
+			size_t);
+void		 chq_dataplot_clear_overlays(chq_dataplot_t *);
+
+/* store.c */
+chq_store_writer_t *chq_store_writer_new(const char *, unsigned int);
+int		 chq_store_writer_append(chq_store_writer_t *, const double *,
+			const double *, size_t);
+int		 chq_store_writer_close(chq_store_writer_t *);
+int		 chq_store_write(const char *, const double *, const double *,
+			size_t, unsigned int);
+chq_store_t	*chq_store_open(const char *);
+void		 chq_store_kill(chq_store_t *);
+size_t		 chq_store_read(chq_store_t *, uint64_t, const double **,
+			const double **);
+void		 chq_store_get_limits(chq_store_t *, double *, double *,
+			double *, double *);
+int		 chq_dataplot_reduce_store(chq_dataplot_t *, chq_reduce_t *);
+void		 chq_dataplot_set_store(chq_dataplot_t *, chq_store_t *);
+
+/* pool.c */
+chq_pool_t	*chq_pool_new(unsigned int);
+void		 chq_pool_kill(chq_pool_t *);
+cairo_t		*chq_pool_acquire(chq_pool_t *, cairo_format_t, int, int, int);
+void		 chq_pool_release(chq_pool_t *, cairo_t *);
+
+/* vector.c */
+int		 chq_dataplot_render_svg(chq_dataplot_t *, const char *);
+int		 chq_dataplot_render_pdf(chq_dataplot_t *, const char *);
+
+/* csv.c */
+double		 chq_csv_parse_double(const char *, const char *);
+chq_csv_t	*chq_csv_open(const char *);
+void		 chq_csv_kill(chq_csv_t *);
+int		 chq_csv_get_column(chq_csv_t *, const char *);
+size_t		 chq_csv_read_columns(chq_csv_t *, unsigned int, unsigned int,
+			double **, double **);
+size_t		 chq_csv_stream(chq_csv_t *, unsigned int, unsigned int,
+			double *, double *, size_t, size_t *);
+
+#endif /* !_CHARTESQUE_H_ */
@@ -0,0 +1,863 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Python module wrapping chq_dataplot_t as chartesque.Chart, and its axes
+ * as chartesque.Axis.
+ *
+ * The data is taken from any object supporting the buffer protocol. A
+ * contiguous array of native float64, float32 or int64 is used in place
+ * (the data pass has a kernel for each type): the Py_buffer is held by a
+ * chq_buffer and released with it, which keeps the exporting object alive
+ * for as long as a chart uses it. The export only prevents the array from
+ * being resized, values written to it show up in the next render.
+ * Anything else (other numeric types, strided views) is converted into a
+ * private copy. Renders run without the GIL, a chart refuses to be changed
+ * while one of them is in progress.
+ *
+ * An Axis holds a reference to its chart rather than to the chq_axis_t,
+ * which Chart.__init__ may replace.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include "chartesque.h"
+
+typedef struct {
+	PyObject_HEAD
+	chq_dataplot_t	*chart;
+	int		 busy;
+} ChartObject;
+
+typedef struct {
+	PyObject_HEAD
+	ChartObject	*chart;
+	int		 vertical;
+} AxisObject;
+
+struct png_stream {
+	unsigned char	*data;
+	size_t		 len;
+	size_t		 size;
+};
+
+static int		 native_format(const char *, char *);
+static int		 column_type(char, Py_ssize_t, enum column_type *);
+static double		 buffer_item(const char *, char, Py_ssize_t);
+static void		 buffer_release(void *);
+static chq_buffer_t	*buffer_from_object(PyObject *);
+static int		 chart_check_idle(ChartObject *);
+static chq_axis_t	*axis_get(AxisObject *);
+static PyObject		*axis_new(ChartObject *, int);
+static cairo_status_t	 png_write(void *, const unsigned char *,
+			    unsigned int);
+
+
+/**
+ * Get the struct module code of a format string describing a single item
+ * in native byte order, returns -1 for anything else.
+ */
+static int
+native_format(const char *format, char *code)
+{
+	const union { uint16_t i; uint8_t c[2]; } order = { 1 };
+	char native = order.c[0] ? '<' : '>';
+
+	if (format == NULL)
+		format = "B";
+	if (*format == '@' || *format == '=' || *format == native)
+		format++;
+	if (strlen(format) != 1 || strchr("dfqQlLiIhHbBnN", *format) == NULL)
+		return -1;
+
+	*code = *format;
+	return 0;
+}
+
+
+/**
+ * Get the column type the data pass reads in place for items of the given
+ * struct module code and size, returns -1 if they must be converted.
+ */
+static int
+column_type(char code, Py_ssize_t itemsize, enum column_type *type)
+{
+	if (code == 'd' && itemsize == sizeof(double))
+		*type = CHQ_COLUMN_DOUBLE;
+	else if (code == 'f' && itemsize == sizeof(float))
+		*type = CHQ_COLUMN_FLOAT;
+	else if ((code == 'q' || code == 'l') && itemsize == sizeof(int64_t))
+		*type = CHQ_COLUMN_INT64;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/**
+ * Read one item of the given struct module code as a double.
+ */
+static double
+buffer_item(const char *p, char code, Py_ssize_t itemsize)
+{
+	switch (code) {
+	case 'd':
+		return *(const double *)p;
+	case 'f':
+		return *(const float *)p;
+	case 'b':
+		return *(const signed char *)p;
+	case 'B':
+		return *(const unsigned char *)p;
+	case 'h':
+		return *(const short *)p;
+	case 'H':
+		return *(const unsigned short *)p;
+	case 'i':
+		return *(const int *)p;
+	case 'I':
+		return *(const unsigned int *)p;
+	case 'n':
+		return *(const Py_ssize_t *)p;
+	case 'N':
+		return *(const size_t *)p;
+	case 'l':
+	case 'q':
+		return itemsize == 4 ? *(const int32_t *)p :
+			*(const int64_t *)p;
+	case 'L':
+	case 'Q':
+		return itemsize == 4 ? *(const uint32_t *)p :
+			*(const uint64_t *)p;
+	}
+
+	return NAN;
+}
+
+
+/**
+ * free_func of the chq_buffers wrapping a Py_buffer. The last reference
+ * may be dropped from any thread, so the GIL is taken here.
+ */
+static void
+buffer_release(void *data)
+{
+	Py_buffer *view = data;
+	PyGILState_STATE state = PyGILState_Ensure();
+
+	PyBuffer_Release(view);
+	PyMem_RawFree(view);
+
+	PyGILState_Release(state);
+}
+
+
+/**
+ * Make a chq_buffer of the one-dimension buffer exported by obj, sharing
+ * its memory if possible. Sets a Python exception and returns NULL on
+ * failure.
+ */
+static chq_buffer_t *
+buffer_from_object(PyObject *obj)
+{
+	Py_buffer *view;
+	chq_buffer_t *buffer;
+	enum column_type type;
+	Py_ssize_t i, len, stride;
+	double *copy;
+	char code;
+
+	view = PyMem_RawMalloc(sizeof(Py_buffer));
+	if (view == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS_RO) == -1) {
+		PyMem_RawFree(view);
+		return NULL;
+	}
+
+	if (view->ndim != 1 || native_format(view->format, &code) == -1) {
+		PyErr_Format(PyExc_TypeError, "expected a one-dimension array "
+		    "of native numbers, got format '%s' with %d dimensions",
+		    view->format ? view->format : "B", view->ndim);
+		goto fail;
+	}
+
+	len = view->shape[0];
+	stride = view->strides[0];
+
+	/* Shared, the view is released along with the buffer. */
+	if (column_type(code, view->itemsize, &type) == 0 &&
+	    stride == view->itemsize) {
+		buffer = chq_buffer_new_wrap(view->buf, type, len,
+				buffer_release, view);
+		if (buffer == NULL) {
+			PyErr_NoMemory();
+			goto fail;
+		}
+		return buffer;
+	}
+
+	copy = malloc(sizeof(double) * (len ? len : 1));
+	if (copy == NULL) {
+		PyErr_NoMemory();
+		goto fail;
+	}
+	for (i = 0; i < len; i++)
+		copy[i] = buffer_item((const char *)view->buf + i * stride,
+		    code, view->itemsize);
+	PyBuffer_Release(view);
+	PyMem_RawFree(view);
+
+	buffer = chq_buffer_new_wrap(copy, CHQ_COLUMN_DOUBLE, len, free, copy);
+	if (buffer == NULL) {
+		free(copy);
+		PyErr_NoMemory();
+	}
+	return buffer;
+
+fail:
+	PyBuffer_Release(view);
+	PyMem_RawFree(view);
+	return NULL;
+}
+
+
+/**
+ * Raise if the chart was not initialized or if a render of it is running in
+ * another thread.
+ */
+static int
+chart_check_idle(ChartObject *self)
+{
+	if (self->chart == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "chart not initialized");
+		return -1;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,
+		    "chart is being rendered by another thread");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int
+Chart_init(ChartObject *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "width", "height", NULL };
+	unsigned int width = 800, height = 600;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|II", kwlist, &width,
+	    &height))
+		return -1;
+	if (width == 0 || height == 0) {
+		PyErr_SetString(PyExc_ValueError, "empty chart");
+		return -1;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,
+		    "chart is being rendered by another thread");
+		return -1;
+	}
+
+	if (self->chart != NULL)
+		chq_dataplot_kill(self->chart);
+	self->chart = chq_dataplot_new();
+	chq_dataplot_set_width(self->chart, width);
+	chq_dataplot_set_height(self->chart, height);
+
+	return 0;
+}
+
+
+static void
+Chart_dealloc(ChartObject *self)
+{
+	if (self->chart != NULL)
+		chq_dataplot_kill(self->chart);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+PyDoc_STRVAR(Chart_set_data_doc,
+"set_data(x, y)\n\n"
+"Plot the values of two arrays. Contiguous float64, float32 and int64\n"
+"arrays are used in place and kept alive by the chart: they cannot be\n"
+"resized meanwhile, but values written to them show up in the next\n"
+"render. Other numeric arrays are copied.");
+
+static PyObject *
+Chart_set_data(ChartObject *self, PyObject *args)
+{
+	PyObject *x, *y;
+	chq_buffer_t *buffer_x, *buffer_y;
+
+	if (!PyArg_ParseTuple(args, "OO", &x, &y))
+		return NULL;
+	if (chart_check_idle(self) == -1)
+		return NULL;
+
+	buffer_x = buffer_from_object(x);
+	if (buffer_x == NULL)
+		return NULL;
+	buffer_y = buffer_from_object(y);
+	if (buffer_y == NULL) {
+		chq_buffer_unref(buffer_x);
+		return NULL;
+	}
+
+	chq_dataplot_set_buffers(self->chart, buffer_x, buffer_y);
+	chq_buffer_unref(buffer_x);
+	chq_buffer_unref(buffer_y);
+
+	Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(Chart_set_x_limit_doc,
+"set_x_limit(min, max)\n\nSet the range of the X axis.");
+
+static PyObject *
+Chart_set_x_limit(ChartObject *self, PyObject *args)
+{
+	double min, max;
+
+	if (!PyArg_ParseTuple(args, "dd", &min, &max))
+		return NULL;
+	if (chart_check_idle(self) == -1)
+		return NULL;
+
+	chq_axis_set_limit(self->chart->x_axis, min, max);
+	chq_dataplot_restart(self->chart);
+
+	Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(Chart_set_y_limit_doc,
+"set_y_limit(min, max)\n\nSet the range of the Y axis.");
+
+static PyObject *
+Chart_set_y_limit(ChartObject *self, PyObject *args)
+{
+	double min, max;
+
+	if (!PyArg_ParseTuple(args, "dd", &min, &max))
+		return NULL;
+	if (chart_check_idle(self) == -1)
+		return NULL;
+
+	chq_axis_set_limit(self->chart->y_axis, min, max);
+	chq_dataplot_restart(self->chart);
+
+	Py_RETURN_NONE;
+}
+
+
+/**
+ * Accumulate the output of cairo_surface_write_to_png_stream().
+ */
+static cairo_status_t
+png_write(void *closure, const unsigned char *data, unsigned int len)
+{
+	struct png_stream *stream = closure;
+	unsigned char *grown;
+	size_t size;
+
+	if (stream->len + len > stream->size) {
+		size = stream->size ? stream->size * 2 : 65536;
+		while (size < stream->len + len)
+			size *= 2;
+		grown = realloc(stream->data, size);
+		if (grown == NULL)
+			return CAIRO_STATUS_NO_MEMORY;
+		stream->data = grown;
+		stream->size = size;
+	}
+
+	memcpy(stream->data + stream->len, data, len);
+	stream->len += len;
+
+	return CAIRO_STATUS_SUCCESS;
+}
+
+
+PyDoc_STRVAR(Chart_render_png_doc,
+"render_png() -> bytes\n\nRender the chart to a PNG image.");
+
+static PyObject *
+Chart_render_png(ChartObject *self, PyObject *unused)
+{
+	struct png_stream stream = { NULL, 0, 0 };
+	cairo_surface_t *surface;
+	cairo_status_t status;
+	cairo_t *cr;
+	PyObject *png;
+
+	if (chart_check_idle(self) == -1)
+		return NULL;
+
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			self->chart->width, self->chart->height);
+	cr = cairo_create(surface);
+	chq_dataplot_render(self->chart, cr);
+	status = cairo_status(cr);
+	cairo_destroy(cr);
+	if (status == CAIRO_STATUS_SUCCESS)
+		status = cairo_surface_write_to_png_stream(surface, png_write,
+				&stream);
+	cairo_surface_destroy(surface);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+
+	if (status != CAIRO_STATUS_SUCCESS) {
+		free(stream.data);
+		PyErr_Format(PyExc_RuntimeError, "cannot render: %s",
+		    cairo_status_to_string(status));
+		return NULL;
+	}
+
+	png = PyBytes_FromStringAndSize((const char *)stream.data, stream.len);
+	free(stream.data);
+
+	return png;
+}
+
+
+PyDoc_STRVAR(Chart_render_into_doc,
+"render_into(buffer, stride=width * 4)\n\n"
+"Render the chart over the pixels of a writable buffer, height rows of\n"
+"stride bytes of native-endian premultiplied ARGB32, as used by cairo.");
+
+static PyObject *
+Chart_render_into(ChartObject *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "buffer", "stride", NULL };
+	Py_buffer view;
+	int stride = -1, error;
+
+	if (chart_check_idle(self) == -1)
+		return NULL;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|i", kwlist, &view,
+	    &stride))
+		return NULL;
+	if (stride == -1)
+		stride = self->chart->width * 4;
+
+	if (stride < (int)self->chart->width * 4 || stride % 4 != 0 ||
+	    view.len < (Py_ssize_t)stride * self->chart->height) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError,
+		    "buffer too small for the chart");
+		return NULL;
+	}
+
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	error = chq_dataplot_render_to_buffer(self->chart, view.buf, stride,
+			CAIRO_FORMAT_ARGB32);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+
+	PyBuffer_Release(&view);
+
+	if (error == -1) {
+		PyErr_SetString(PyExc_RuntimeError, "cannot render");
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+
+/**
+ * Get the chq_axis_t an Axis stands for, raises if its chart was not
+ * initialized.
+ */
+static chq_axis_t *
+axis_get(AxisObject *self)
+{
+	chq_dataplot_t *chart = self->chart->chart;
+
+	if (chart == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "chart not initialized");
+		return NULL;
+	}
+
+	return self->vertical ? chart->y_axis : chart->x_axis;
+}
+
+
+static void
+Axis_dealloc(AxisObject *self)
+{
+	Py_DECREF(self->chart);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+PyDoc_STRVAR(Axis_set_limit_doc,
+"set_limit(min, max)\n\nSet the range of the axis.");
+
+static PyObject *
+Axis_set_limit(AxisObject *self, PyObject *args)
+{
+	double min, max;
+
+	if (!PyArg_ParseTuple(args, "dd", &min, &max))
+		return NULL;
+	if (chart_check_idle(self->chart) == -1)
+		return NULL;
+
+	chq_axis_set_limit(axis_get(self), min, max);
+	chq_dataplot_restart(self->chart->chart);
+
+	Py_RETURN_NONE;
+}
+
+
+static PyObject *
+Axis_get_limit(AxisObject *self, void *closure)
+{
+	chq_axis_t *axis = axis_get(self);
+
+	if (axis == NULL)
+		return NULL;
+	return Py_BuildValue("(dd)", axis->limit_min, axis->limit_max);
+}
+
+
+static PyObject *
+Axis_get_type(AxisObject *self, void *closure)
+{
+	chq_axis_t *axis = axis_get(self);
+
+	if (axis == NULL)
+		return NULL;
+	return PyUnicode_FromString(axis->type == CHQ_AXIS_TIME ? "time" :
+	    "linear");
+}
+
+
+static int
+Axis_set_type(AxisObject *self, PyObject *value, void *closure)
+{
+	enum axis_type type;
+	const char *name;
+
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError, "cannot delete the type");
+		return -1;
+	}
+	name = PyUnicode_AsUTF8(value);
+	if (name == NULL)
+		return -1;
+	if (strcmp(name, "linear") == 0)
+		type = CHQ_AXIS_LINEAR;
+	else if (strcmp(name, "time") == 0)
+		type = CHQ_AXIS_TIME;
+	else {
+		PyErr_Format(PyExc_ValueError,
+		    "expected 'linear' or 'time', got '%s'", name);
+		return -1;
+	}
+	if (chart_check_idle(self->chart) == -1)
+		return -1;
+
+	chq_axis_set_type(axis_get(self), type);
+	chq_dataplot_restart(self->chart->chart);
+
+	return 0;
+}
+
+
+static PyObject *
+Axis_get_font_family(AxisObject *self, void *closure)
+{
+	chq_axis_t *axis = axis_get(self);
+
+	if (axis == NULL)
+		return NULL;
+	return PyUnicode_FromString(axis->label_fontfamily);
+}
+
+
+static int
+Axis_set_font_family(AxisObject *self, PyObject *value, void *closure)
+{
+	chq_axis_t *axis;
+	const char *family;
+
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError, "cannot delete the font");
+		return -1;
+	}
+	family = PyUnicode_AsUTF8(value);
+	if (family == NULL)
+		return -1;
+	if (chart_check_idle(self->chart) == -1)
+		return -1;
+
+	axis = axis_get(self);
+	if (chq_axis_set_label_font(axis, family, axis->label_fontsize) == -1) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	chq_dataplot_restart(self->chart->chart);
+
+	return 0;
+}
+
+
+static PyObject *
+Axis_get_font_size(AxisObject *self, void *closure)
+{
+	chq_axis_t *axis = axis_get(self);
+
+	if (axis == NULL)
+		return NULL;
+	return PyFloat_FromDouble(axis->label_fontsize);
+}
+
+
+static int
+Axis_set_font_size(AxisObject *self, PyObject *value, void *closure)
+{
+	chq_axis_t *axis;
+	double size;
+
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError, "cannot delete the font size");
+		return -1;
+	}
+	size = PyFloat_AsDouble(value);
+	if (size == -1.0 && PyErr_Occurred())
+		return -1;
+	if (!(size > 0.0) || !isfinite(size)) {
+		PyErr_SetString(PyExc_ValueError, "font size must be positive");
+		return -1;
+	}
+	if (chart_check_idle(self->chart) == -1)
+		return -1;
+
+	axis = axis_get(self);
+	if (chq_axis_set_label_font(axis, axis->label_fontfamily, size) == -1) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	chq_dataplot_restart(self->chart->chart);
+
+	return 0;
+}
+
+
+/**
+ * The ticks of the last render, as (position, label) pairs.
+ */
+static PyObject *
+Axis_get_ticks(AxisObject *self, void *closure)
+{
+	chq_axis_t *axis;
+	PyObject *ticks, *tick;
+	unsigned int i;
+
+	if (chart_check_idle(self->chart) == -1)
+		return NULL;
+	axis = axis_get(self);
+
+	ticks = PyList_New(axis->ticks_count);
+	if (ticks == NULL)
+		return NULL;
+	for (i = 0; i < axis->ticks_count; i++) {
+		tick = Py_BuildValue("(ds)", axis->ticks_positions[i],
+		    axis->ticks_labels[i]);
+		if (tick == NULL) {
+			Py_DECREF(ticks);
+			return NULL;
+		}
+		PyList_SET_ITEM(ticks, i, tick);
+	}
+
+	return ticks;
+}
+
+
+static PyMethodDef Axis_methods[] = {
+	{ "set_limit", (PyCFunction)Axis_set_limit, METH_VARARGS,
+	    Axis_set_limit_doc },
+	{ NULL }
+};
+
+static PyGetSetDef Axis_getset[] = {
+	{ "limit", (getter)Axis_get_limit, NULL, "(min, max) of the axis",
+	    NULL },
+	{ "type", (getter)Axis_get_type, (setter)Axis_set_type,
+	    "'linear' for numbers, 'time' for seconds since the epoch", NULL },
+	{ "font_family", (getter)Axis_get_font_family,
+	    (setter)Axis_set_font_family, "font family of the labels", NULL },
+	{ "font_size", (getter)Axis_get_font_size,
+	    (setter)Axis_set_font_size, "font size of the labels", NULL },
+	{ "ticks", (getter)Axis_get_ticks, NULL,
+	    "(position, label) of the ticks of the last render, the position "
+	    "in pixels from the left (or top) of the plot", NULL },
+	{ NULL }
+};
+
+static PyTypeObject AxisType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "chartesque.Axis",
+	.tp_doc = "Axis of a chart, as Chart.x_axis and Chart.y_axis.",
+	.tp_basicsize = sizeof(AxisObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_dealloc = (destructor)Axis_dealloc,
+	.tp_methods = Axis_methods,
+	.tp_getset = Axis_getset,
+};
+
+
+/**
+ * Make an Axis standing for the X (or the Y if vertical) axis of chart.
+ */
+static PyObject *
+axis_new(ChartObject *chart, int vertical)
+{
+	AxisObject *self;
+
+	self = PyObject_New(AxisObject, &AxisType);
+	if (self == NULL)
+		return NULL;
+	Py_INCREF(chart);
+	self->chart = chart;
+	self->vertical = vertical;
+
+	return (PyObject *)self;
+}
+
+
+static PyObject *
+Chart_get_width(ChartObject *self, void *closure)
+{
+	if (self->chart == NULL)
+		return PyLong_FromLong(0);
+	return PyLong_FromUnsignedLong(self->chart->width);
+}
+
+
+static PyObject *
+Chart_get_height(ChartObject *self, void *closure)
+{
+	if (self->chart == NULL)
+		return PyLong_FromLong(0);
+	return PyLong_FromUnsignedLong(self->chart->height);
+}
+
+
+static PyObject *
+Chart_get_x_axis(ChartObject *self, void *closure)
+{
+	return axis_new(self, 0);
+}
+
+
+static PyObject *
+Chart_get_y_axis(ChartObject *self, void *closure)
+{
+	return axis_new(self, 1);
+}
+
+
+static PyMethodDef Chart_methods[] = {
+	{ "set_data", (PyCFunction)Chart_set_data, METH_VARARGS,
+	    Chart_set_data_doc },
+	{ "set_x_limit", (PyCFunction)Chart_set_x_limit, METH_VARARGS,
+	    Chart_set_x_limit_doc },
+	{ "set_y_limit", (PyCFunction)Chart_set_y_limit, METH_VARARGS,
+	    Chart_set_y_limit_doc },
+	{ "render_png", (PyCFunction)Chart_render_png, METH_NOARGS,
+	    Chart_render_png_doc },
+	{ "render_into", (PyCFunction)(void (*)(void))Chart_render_into,
+	    METH_VARARGS | METH_KEYWORDS, Chart_render_into_doc },
+	{ NULL }
+};
+
+static PyGetSetDef Chart_getset[] = {
+	{ "width", (getter)Chart_get_width, NULL, "width in pixels", NULL },
+	{ "height", (getter)Chart_get_height, NULL, "height in pixels", NULL },
+	{ "x_axis", (getter)Chart_get_x_axis, NULL, "horizontal Axis", NULL },
+	{ "y_axis", (getter)Chart_get_y_axis, NULL, "vertical Axis", NULL },
+	{ NULL }
+};
+
+static PyTypeObject ChartType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "chartesque.Chart",
+	.tp_doc = "Chart(width=800, height=600)",
+	.tp_basicsize = sizeof(ChartObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)Chart_init,
+	.tp_dealloc = (destructor)Chart_dealloc,
+	.tp_methods = Chart_methods,
+	.tp_getset = Chart_getset,
+};
+
+static struct PyModuleDef chartesque_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "chartesque",
+	.m_doc = "Data plotter using cairo.",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_chartesque(void);
+
+PyMODINIT_FUNC
+PyInit_chartesque(void)
+{
+	PyObject *module;
+
+	if (PyType_Ready(&ChartType) < 0 || PyType_Ready(&AxisType) < 0)
+		return NULL;
+
+	module = PyModule_Create(&chartesque_module);
+	if (module == NULL)
+		return NULL;
+
+	Py_INCREF(&ChartType);
+	if (PyModule_AddObject(module, "Chart", (PyObject *)&ChartType) < 0) {
+		Py_DECREF(&ChartType);
+		Py_DECREF(module);
+		return NULL;
+	}
+	Py_INCREF(&AxisType);
+	if (PyModule_AddObject(module, "Axis", (PyObject *)&AxisType) < 0) {
+		Py_DECREF(&AxisType);
+		Py_DECREF(module);
+		return NULL;
+	}
+
+	return module;
+}
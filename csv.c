@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chartesque.h"
+
+/* Below this size, spawning threads costs more than it saves. */
+#define CSV_THREAD_THRESHOLD	(1024 * 1024)
+#define CSV_MAX_THREADS		16
+
+/* Exact powers of ten representable as a double. */
+static const double csv_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+struct csv_job {
+	chq_csv_t	*csv;
+	const char	*start;
+	const char	*end;
+	unsigned int	 x_col;
+	unsigned int	 y_col;
+	size_t		 rows;
+	double		*data_x;
+	double		*data_y;
+};
+
+static const char	*csv_line_end(const char *, const char *);
+static const char	*csv_next_field(chq_csv_t *, const char *, const char *);
+static size_t		 csv_scan(chq_csv_t *, const char *, const char *,
+			    unsigned int, unsigned int, double *, double *);
+static void		*csv_scan_thread(void *);
+static void		 csv_run_jobs(struct csv_job *, unsigned int);
+static int		 csv_read_header(chq_csv_t *);
+
+
+/**
+ * Parse a number from the given range without going through strtod(3), it
+ * ignores the locale and only understands plain decimal notation with an
+ * optional exponent. Anything else (empty field, "NA", ...) is NAN.
+ */
+double
+chq_csv_parse_double(const char *p, const char *end)
+{
+	uint64_t mantissa = 0;
+	int exponent = 0, exp_value = 0, exp_negative = 0;
+	int digits = 0, seen = 0, negative = 0;
+	double value;
+
+	while (p < end && (*p == ' ' || *p == '"'))
+		p++;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		seen = 1;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0)
+				digits++;
+		} else {
+			exponent++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			seen = 1;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0)
+					digits++;
+				exponent--;
+			}
+		}
+	}
+
+	if (!seen)
+		return NAN;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		if (p < end && (*p == '-' || *p == '+')) {
+			exp_negative = (*p == '-');
+			p++;
+		}
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (exp_value < 10000)
+				exp_value = exp_value * 10 + (*p - '0');
+		}
+		exponent += exp_negative ? -exp_value : exp_value;
+	}
+
+	value = (double)mantissa;
+	if (exponent < 0 && exponent >= -22)
+		value /= csv_pow10[-exponent];
+	else if (exponent > 0 && exponent <= 22)
+		value *= csv_pow10[exponent];
+	else if (exponent != 0)
+		value *= pow(10.0, exponent);
+
+	return negative ? -value : value;
+}
+
+
+/**
+ * Return the end of the line starting at p, the newline itself or end.
+ */
+static const char *
+csv_line_end(const char *p, const char *end)
+{
+	const char *nl = memchr(p, '\n', end - p);
+
+	return nl == NULL ? end : nl;
+}
+
+
+/**
+ * Return the start of the field after the one starting at p, or NULL if
+ * this was the last field of the line ending at end.
+ */
+static const char *
+csv_next_field(chq_csv_t *csv, const char *p, const char *end)
+{
+	if (p < end && *p == '"') {
+		for (p++; p < end && *p != '"'; p++)
+			;
+	}
+
+	p = memchr(p, csv->delimiter, end - p);
+
+	return p == NULL ? NULL : p + 1;
+}
+
+
+/**
+ * Walk the lines in [start, end) and return the number of rows. If data_x
+ * is not NULL, the x_col and y_col fields are parsed into data_x and data_y.
+ * Counting and parsing share this loop so both passes agree on what a row
+ * is (empty lines are skipped).
+ */
+static size_t
+csv_scan(chq_csv_t *csv, const char *start, const char *end,
+		unsigned int x_col, unsigned int y_col, double *data_x,
+		double *data_y)
+{
+	const char *p = start, *eol, *field, *next;
+	unsigned int col;
+	size_t rows = 0;
+
+	while (p < end) {
+		eol = csv_line_end(p, end);
+		if (eol > p && eol[-1] == '\r')
+			eol--;
+
+		if (eol > p) {
+			if (data_x != NULL) {
+				data_x[rows] = NAN;
+				data_y[rows] = NAN;
+				field = p;
+				for (col = 0; field != NULL; col++) {
+					next = csv_next_field(csv, field, eol);
+					if (col == x_col)
+						data_x[rows] = chq_csv_parse_double(
+						    field, next ? next - 1 : eol);
+					if (col == y_col)
+						data_y[rows] = chq_csv_parse_double(
+						    field, next ? next - 1 : eol);
+					if (col >= x_col && col >= y_col)
+						break;
+					field = next;
+				}
+			}
+			rows++;
+		}
+
+		p = csv_line_end(p, end) + 1;
+	}
+
+	return rows;
+}
+
+
+static void *
+csv_scan_thread(void *arg)
+{
+	struct csv_job *job = arg;
+
+	job->rows = csv_scan(job->csv, job->start, job->end, job->x_col,
+			job->y_col, job->data_x, job->data_y);
+
+	return NULL;
+}
+
+
+/**
+ * Scan the chunks of all the jobs, the first one in this thread and the
+ * others in threads of their own. A chunk whose thread could not be created
+ * is scanned here once the first one is done.
+ */
+static void
+csv_run_jobs(struct csv_job *jobs, unsigned int count)
+{
+	pthread_t threads[CSV_MAX_THREADS];
+	int started[CSV_MAX_THREADS];
+	unsigned int i;
+
+	for (i = 1; i < count; i++)
+		started[i] = pthread_create(&threads[i], NULL,
+		    csv_scan_thread, &jobs[i]) == 0;
+	csv_scan_thread(&jobs[0]);
+	for (i = 1; i < count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			csv_scan_thread(&jobs[i]);
+	}
+}
+
+
+/**
+ * Split the first line into column names, unless it looks like data in
+ * which case the columns stay anonymous and the line is kept as a row. The
+ * quotes around a name are not part of it. Returns -1 if out of memory.
+ */
+static int
+csv_read_header(chq_csv_t *csv)
+{
+	const char *end = csv->map + csv->map_len;
+	const char *eol = csv_line_end(csv->map, end);
+	const char *field, *next, *stop, *last;
+	unsigned int i;
+
+	csv->delimiter = memchr(csv->map, '\t', eol - csv->map) ? '\t' : ',';
+	csv->body = csv->map;
+	csv->body_len = csv->map_len;
+
+	stop = (eol > csv->map && eol[-1] == '\r') ? eol - 1 : eol;
+
+	csv->columns_count = 0;
+	for (field = csv->map; field != NULL;
+	    field = csv_next_field(csv, field, stop))
+		csv->columns_count++;
+
+	if (!isnan(chq_csv_parse_double(csv->map, stop)))
+		return 0;
+
+	csv->columns_names = calloc(csv->columns_count, sizeof(char *));
+	if (csv->columns_names == NULL)
+		return -1;
+
+	field = csv->map;
+	for (i = 0; i < csv->columns_count; i++) {
+		next = csv_next_field(csv, field, stop);
+		last = next ? next - 1 : stop;
+		if (last - field >= 2 && *field == '"' && last[-1] == '"') {
+			field++;
+			last--;
+		}
+		csv->columns_names[i] = strndup(field, last - field);
+		if (csv->columns_names[i] == NULL)
+			return -1;
+		field = next;
+	}
+
+	csv->body = eol < end ? eol + 1 : end;
+	csv->body_len = end - csv->body;
+
+	return 0;
+}
+
+
+/**
+ * Map a CSV (or TSV, if the first line has tabs) file in memory. Returns
+ * NULL if the file cannot be opened or mapped, or its header not read.
+ */
+chq_csv_t *
+chq_csv_open(const char *path)
+{
+	chq_csv_t *csv;
+	struct stat st;
+
+	csv = calloc(1, sizeof(chq_csv_t));
+	if (csv == NULL)
+		return NULL;
+
+	csv->fd = open(path, O_RDONLY);
+	if (csv->fd == -1 || fstat(csv->fd, &st) == -1 || st.st_size == 0)
+		goto fail;
+
+	csv->map_len = st.st_size;
+	csv->map = mmap(NULL, csv->map_len, PROT_READ, MAP_PRIVATE, csv->fd,
+			0);
+	if (csv->map == MAP_FAILED) {
+		csv->map = NULL;
+		goto fail;
+	}
+	madvise(csv->map, csv->map_len, MADV_SEQUENTIAL);
+
+	if (csv_read_header(csv) == -1)
+		goto fail;
+
+	return csv;
+
+fail:
+	chq_csv_kill(csv);
+	return NULL;
+}
+
+
+/**
+ * Destructor for a chq_csv.
+ */
+void
+chq_csv_kill(chq_csv_t *csv)
+{
+	unsigned int i;
+
+	if (csv->map != NULL)
+		munmap(csv->map, csv->map_len);
+	if (csv->fd != -1)
+		close(csv->fd);
+
+	if (csv->columns_names != NULL) {
+		for (i = 0; i < csv->columns_count; i++)
+			free(csv->columns_names[i]);
+		free(csv->columns_names);
+	}
+	free(csv);
+}
+
+
+/**
+ * Look up a column by header name or by number (starting at 1). Returns
+ * the zero-based column index or -1 if there is no such column.
+ */
+int
+chq_csv_get_column(chq_csv_t *csv, const char *name)
+{
+	unsigned int i;
+	char *end;
+	long n;
+
+	if (csv->columns_names != NULL) {
+		for (i = 0; i < csv->columns_count; i++) {
+			if (strcmp(csv->columns_names[i], name) == 0)
+				return i;
+		}
+	}
+
+	n = strtol(name, &end, 10);
+	if (*name == '\0' || *end != '\0' || n < 1 || n > csv->columns_count)
+		return -1;
+
+	return n - 1;
+}
+
+
+/**
+ * Parse two columns of the whole file into newly allocated arrays, set on
+ * *data_x and *data_y. The mapping is split in chunks on line boundaries
+ * which are counted then parsed in parallel, each thread writing straight
+ * to its slice of the columns. Returns the number of rows, on failure 0 is
+ * returned and nothing is allocated.
+ */
+size_t
+chq_csv_read_columns(chq_csv_t *csv, unsigned int x_col, unsigned int y_col,
+		double **data_x, double **data_y)
+{
+	struct csv_job jobs[CSV_MAX_THREADS];
+	const char *p, *end = csv->body + csv->body_len;
+	unsigned int i, count = 1;
+	size_t rows = 0;
+	long ncpu;
+
+	*data_x = NULL;
+	*data_y = NULL;
+
+	if (csv->body_len >= CSV_THREAD_THRESHOLD) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		count = ncpu < 1 ? 1 : ncpu > CSV_MAX_THREADS ?
+			CSV_MAX_THREADS : ncpu;
+	}
+
+	/* Chunk boundaries, moved forward to the next line. */
+	p = csv->body;
+	for (i = 0; i < count; i++) {
+		jobs[i].csv = csv;
+		jobs[i].x_col = x_col;
+		jobs[i].y_col = y_col;
+		jobs[i].data_x = NULL;
+		jobs[i].data_y = NULL;
+		jobs[i].start = p;
+		if (i == count - 1) {
+			p = end;
+		} else {
+			p = csv->body + csv->body_len / count * (i + 1);
+			if (p < jobs[i].start)
+				p = jobs[i].start;
+			if (p < end)
+				p = csv_line_end(p, end) + 1;
+			if (p > end)
+				p = end;
+		}
+		jobs[i].end = p;
+	}
+
+	/* First pass, count the rows of each chunk. */
+	csv_run_jobs(jobs, count);
+
+	for (i = 0; i < count; i++)
+		rows += jobs[i].rows;
+	if (rows == 0)
+		return 0;
+
+	*data_x = malloc(sizeof(double) * rows);
+	*data_y = malloc(sizeof(double) * rows);
+	if (*data_x == NULL || *data_y == NULL) {
+		free(*data_x);
+		free(*data_y);
+		*data_x = NULL;
+		*data_y = NULL;
+		return 0;
+	}
+
+	/* Second pass, parse each chunk at its offset in the columns. */
+	jobs[0].data_x = *data_x;
+	jobs[0].data_y = *data_y;
+	for (i = 1; i < count; i++) {
+		jobs[i].data_x = jobs[i - 1].data_x + jobs[i - 1].rows;
+		jobs[i].data_y = jobs[i - 1].data_y + jobs[i - 1].rows;
+	}
+	csv_run_jobs(jobs, count);
+
+	return rows;
+}
+
+
+/**
+ * Parse at most len rows of two columns into the caller's arrays, starting
+ * at the byte *offset of the body (start with 0). The offset is advanced
+ * past the rows read, and the pages already consumed are released so files
+ * larger than memory can be walked in fixed memory. Returns the number of
+ * rows read, 0 at the end of the file.
+ */
+size_t
+chq_csv_stream(chq_csv_t *csv, unsigned int x_col, unsigned int y_col,
+		double *data_x, double *data_y, size_t len, size_t *offset)
+{
+	const char *start = csv->body + *offset, *p = start;
+	const char *end = csv->body + csv->body_len;
+	size_t rows = 0, page = sysconf(_SC_PAGESIZE);
+	uintptr_t from, to;
+
+	while (p < end && rows < len) {
+		rows += csv_scan(csv, p, csv_line_end(p, end), x_col, y_col,
+				data_x + rows, data_y + rows);
+		p = csv_line_end(p, end) + 1;
+	}
+	if (p > end)
+		p = end;
+	*offset = p - csv->body;
+
+	from = ((uintptr_t)start + page - 1) & ~(page - 1);
+	to = (uintptr_t)p & ~(page - 1);
+	if (to > from)
+		madvise((void *)from, to - from, MADV_DONTNEED);
+
+	return rows;
+}
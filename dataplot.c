@@ -22,9 +22,16 @@
 #include <string.h>
 #include <cairo.h>
 #include <math.h>
+#include <time.h>
 
 #include "chartesque.h"
 
+/* Number of points between two checks of the cancel callback. */
+#define CANCEL_INTERVAL	65536
+
+/* Number of points between two checks of the progressive time budget. */
+#define PROGRESS_SLICE	16384
+
 
 /**
  * Constructor for a chq_dataplot with some sane defaults.
@@ -45,6 +52,26 @@ chq_dataplot_new()
 	chart->margin_bottom = 10.0;
 	chart->margin_left = 10.0;
 
+	chart->data_len = 0;
+	chart->data_x = NULL;
+	chart->data_y = NULL;
+	chart->type_x = CHQ_COLUMN_DOUBLE;
+	chart->type_y = CHQ_COLUMN_DOUBLE;
+	chart->buffer_x = NULL;
+	chart->buffer_y = NULL;
+	chart->store = NULL;
+
+	chart->reduce = chq_reduce_new();
+	chart->preview = chq_reduce_new();
+	chart->progress = 0;
+	chart->precision = 0.0;
+	chart->labels_as_text = 0;
+	chart->fast_raster = 0;
+	chart->cancel = NULL;
+	chart->cancel_data = NULL;
+	chart->pick = NULL;
+	chart->overlays = NULL;
+
 	return chart;
 }
 
@@ -57,6 +84,12 @@ chq_dataplot_kill(chq_dataplot_t *chart)
 {
 	chq_axis_kill(chart->x_axis);
 	chq_axis_kill(chart->y_axis);
+	chq_reduce_kill(chart->reduce);
+	chq_reduce_kill(chart->preview);
+	chq_pick_kill(chart->pick);
+	chq_dataplot_clear_overlays(chart);
+	chq_buffer_unref(chart->buffer_x);
+	chq_buffer_unref(chart->buffer_y);
 	free(chart);
 }
 
@@ -98,7 +131,10 @@ chq_dataplot_render_y_label_text(chq_dataplot_t *chart, double y, char *text)
 			chart->y_axis->label_padding +
 			chart->y_axis->label_max_width - extents.width,
 			chart->margin_top + chart->y_axis->label_padding + y);
-	cairo_text_path(chart->cr, text);
+	if (chart->labels_as_text)
+		cairo_show_text(chart->cr, text);
+	else
+		cairo_text_path(chart->cr, text);
 }
 
 
@@ -129,7 +165,10 @@ chq_dataplot_render_x_label_text(chq_dataplot_t *chart, double x, char *text)
 	cairo_move_to(chart->cr, chart->margin_left +
 			chq_axis_vertical_get_width(chart->y_axis) + x -
 			extents.width / 2.0, x_label_y);
-	cairo_text_path(chart->cr, text);
+	if (chart->labels_as_text)
+		cairo_show_text(chart->cr, text);
+	else
+		cairo_text_path(chart->cr, text);
 }
 
 
@@ -175,13 +214,12 @@ chq_dataplot_render_x_axis_labels(chq_dataplot_t *chart)
 
 
 /**
- * Routine drawing the axes.
+ * Measure the labels, size the axes and generate their ticks, without
+ * drawing anything.
  */
 void
-chq_dataplot_render_axes(chq_dataplot_t *chart)
+chq_dataplot_prepare_axes(chq_dataplot_t *chart)
 {
-	double y_axis_width, x_axis_height;
-
 	/* 
 	 * Calculate the max width and heights of the labels, it will be used
 	 * to get a proper size for the axes. The sizing is done on a sample
@@ -201,6 +239,16 @@ chq_dataplot_render_axes(chq_dataplot_t *chart)
 	/* Generate the ticks (positions and labels) */
 	chq_axis_prerender_ticks(chart->x_axis, chart->cr);
 	chq_axis_prerender_ticks(chart->y_axis, chart->cr);
+}
+
+
+/**
+ * Draw the axes and their labels, once prepared.
+ */
+void
+chq_dataplot_draw_axes(chq_dataplot_t *chart)
+{
+	double y_axis_width, x_axis_height;
 
 	/* Select axes color */
 	cairo_set_source_rgb(chart->cr, 0.2, 0.2, 0.2);
@@ -228,40 +276,244 @@ chq_dataplot_render_axes(chq_dataplot_t *chart)
 }
 
 
+/**
+ * Routine drawing the axes.
+ */
+void
+chq_dataplot_render_axes(chq_dataplot_t *chart)
+{
+	chq_dataplot_prepare_axes(chart);
+	chq_dataplot_draw_axes(chart);
+}
+
+
+/**
+ * Start feeding the chart's points to reduce, with one column per device
+ * unit of the current target. The first point is the lower left corner the
+ * area is closed against. The overlays follow the chart's own reducer.
+ */
 void
-chq_dataplot_render_plots(chq_dataplot_t *chart)
+chq_dataplot_reduce_begin(chq_dataplot_t *chart, chq_reduce_t *reduce)
 {
-	size_t i;
-	double x_axis_height = chq_axis_horizontal_get_height(chart->x_axis);
 	double y_axis_width = chq_axis_vertical_get_width(chart->y_axis);
 	double left = chart->margin_left + y_axis_width;
 	double top = chart->margin_top;
-	double x, y;
+	double x, y, resolution = 1.0, unused = 0.0;
+	chq_overlay_t *overlay;
 
-	cairo_save(chart->cr);
+	cairo_device_to_user_distance(chart->cr, &resolution, &unused);
+	chq_reduce_reset(reduce, fabs(resolution), chart->precision);
+
+	if (reduce == chart->reduce)
+		for (overlay = chart->overlays; overlay != NULL;
+		    overlay = overlay->next)
+			chq_overlay_begin(overlay, fabs(resolution),
+			    chart->precision, top, chart->y_axis->size);
 
-	cairo_new_path(chart->cr);
 	x = chq_axis_convert_to_scale(chart->x_axis, chart->x_axis->limit_min);
 	y = chq_axis_convert_to_scale(chart->y_axis, chart->y_axis->limit_min);
-	cairo_move_to(chart->cr, left + x, top + y);
-	for (i = 0; i < chart->data_len; i++) {
-		x = chq_axis_convert_to_scale(chart->x_axis, chart->data_x[i]);
-		y = chq_axis_convert_to_scale(chart->y_axis, chart->data_y[i]);
-		printf("x: %f -> %f\n", chart->data_x[i], x);
-		cairo_line_to(chart->cr, left + x, top + y);
+	chq_reduce_push(reduce, left + x, top + y);
+}
+
+
+/**
+ * Feed every step-th point of two columns of the given types from start to
+ * end (excluded) to reduce, NaN are skipped unless finite says there are
+ * none. Returns -1 if the cancel callback interrupted it, 0 otherwise.
+ */
+static int
+dataplot_reduce_columns(chq_dataplot_t *chart, chq_reduce_t *reduce,
+		enum column_type type_x, const void *data_x,
+		enum column_type type_y, const void *data_y, int finite,
+		size_t start, size_t end, size_t step)
+{
+	chq_kernel_t kernel;
+	size_t i, stop;
+
+	chq_kernel_setup(&kernel, chart, reduce == chart->reduce ?
+			chart->overlays : NULL, type_x, type_y, finite);
+
+	for (i = start; i < end; ) {
+		if (chart->cancel != NULL && chart->cancel(chart->cancel_data))
+			return -1;
+		stop = i + CANCEL_INTERVAL * step;
+		if (stop > end)
+			stop = end;
+		kernel.run(&kernel, reduce, data_x, data_y, i, stop, step);
+		/* Continue where the kernel stopped. */
+		i += (stop - i + step - 1) / step * step;
 	}
 
+	return 0;
+}
+
+
+/**
+ * Feed every step-th point of the arrays from start to end (excluded) to
+ * reduce, NaN are skipped. Returns -1 if the cancel callback interrupted
+ * it, 0 otherwise.
+ */
+int
+chq_dataplot_reduce_array(chq_dataplot_t *chart, chq_reduce_t *reduce,
+		const double *data_x, const double *data_y, size_t start,
+		size_t end, size_t step)
+{
+	return dataplot_reduce_columns(chart, reduce, CHQ_COLUMN_DOUBLE,
+			data_x, CHQ_COLUMN_DOUBLE, data_y, 0, start, end, step);
+}
+
+
+/**
+ * Feed every step-th point of the chart's data from start to end (excluded)
+ * to reduce, see chq_dataplot_reduce_array(). The NaN checks are skipped
+ * for private copies known to have none (see chq_buffer_new()): arrays the
+ * caller still owns may change between two renders.
+ */
+int
+chq_dataplot_reduce_range(chq_dataplot_t *chart, chq_reduce_t *reduce,
+		size_t start, size_t end, size_t step)
+{
+	int finite = chart->buffer_x != NULL && chart->buffer_x->finite &&
+		chart->buffer_y != NULL && chart->buffer_y->finite;
+
+	return dataplot_reduce_columns(chart, reduce, chart->type_x,
+			chart->data_x, chart->type_y, chart->data_y, finite,
+			start, end, step);
+}
+
+
+/**
+ * Append the polyline of a flushed reducer to the current path.
+ */
+static void
+dataplot_path(cairo_t *cr, chq_reduce_t *reduce)
+{
+	size_t i;
+
+	cairo_move_to(cr, reduce->x[0], reduce->y[0]);
+	for (i = 1; i < reduce->len; i++)
+		cairo_line_to(cr, reduce->x[i], reduce->y[i]);
+}
+
+
+/**
+ * Fill and stroke the points of a flushed reducer, with the overlays: the
+ * bands go over the area and under the line, the lines over everything.
+ * Everything is clipped to the plot area, points out of the axes' limits
+ * must not cover the labels. With fast_raster set, image targets are drawn
+ * by raster.c instead of cairo.
+ */
+void
+chq_dataplot_draw_reduced(chq_dataplot_t *chart, chq_reduce_t *reduce)
+{
+	chq_raster_t raster;
+	chq_overlay_t *overlay;
+	cairo_path_t *path = NULL;
+	double left = chart->margin_left +
+		chq_axis_vertical_get_width(chart->y_axis);
+	double top = chart->margin_top;
+
+	if (reduce->len == 0)
+		return;
+
+	for (overlay = chart->overlays; overlay != NULL;
+	    overlay = overlay->next)
+		chq_overlay_snapshot(overlay);
+
+	if (chart->fast_raster && chq_raster_init(&raster, chart->cr) == 0) {
+		chq_raster_clip(&raster, left, top, chart->x_axis->size,
+		    chart->y_axis->size);
+		chq_raster_fill(&raster, reduce, 0.4, 0.6, 1.0);
+		for (overlay = chart->overlays; overlay != NULL;
+		    overlay = overlay->next)
+			if (overlay->type != CHQ_OVERLAY_MEAN)
+				chq_raster_fill(&raster, overlay->outline,
+				    0.7, 0.8, 1.0);
+		chq_raster_stroke(&raster, reduce, 2, 0.2, 0.4, 0.7);
+		for (overlay = chart->overlays; overlay != NULL;
+		    overlay = overlay->next)
+			if (overlay->type == CHQ_OVERLAY_MEAN)
+				chq_raster_stroke(&raster,
+				    overlay->shown_upper, 1, 0.9, 0.5, 0.1);
+		chq_raster_done(&raster);
+		return;
+	}
+
+	cairo_save(chart->cr);
+
+	cairo_new_path(chart->cr);
+	cairo_rectangle(chart->cr, left, top, chart->x_axis->size,
+	    chart->y_axis->size);
+	cairo_clip(chart->cr);
+	dataplot_path(chart->cr, reduce);
+
 	cairo_set_source_rgb(chart->cr, 0.4, 0.6, 1.0);
-	cairo_fill_preserve(chart->cr);
+	if (chart->overlays != NULL) {
+		path = cairo_copy_path(chart->cr);
+		cairo_fill(chart->cr);
+
+		cairo_set_source_rgb(chart->cr, 0.7, 0.8, 1.0);
+		for (overlay = chart->overlays; overlay != NULL;
+		    overlay = overlay->next) {
+			if (overlay->type == CHQ_OVERLAY_MEAN ||
+			    overlay->outline->len == 0)
+				continue;
+			dataplot_path(chart->cr, overlay->outline);
+			cairo_close_path(chart->cr);
+			cairo_fill(chart->cr);
+		}
+
+		cairo_append_path(chart->cr, path);
+		cairo_path_destroy(path);
+	} else {
+		cairo_fill_preserve(chart->cr);
+	}
 
 	cairo_set_source_rgb(chart->cr, 0.2, 0.4, 0.7);
 	cairo_set_line_width(chart->cr, 2);
 	cairo_stroke(chart->cr);
 
+	cairo_set_source_rgb(chart->cr, 0.9, 0.5, 0.1);
+	cairo_set_line_width(chart->cr, 1);
+	for (overlay = chart->overlays; overlay != NULL;
+	    overlay = overlay->next) {
+		if (overlay->type != CHQ_OVERLAY_MEAN ||
+		    overlay->shown_upper->len == 0)
+			continue;
+		dataplot_path(chart->cr, overlay->shown_upper);
+		cairo_stroke(chart->cr);
+	}
+
 	cairo_restore(chart->cr);
 }
 
 
+/**
+ * Routine drawing the data. The points go through the chart's reducer, so
+ * the size of the path depends on the size of the output rather than on
+ * data_len.
+ */
+void
+chq_dataplot_render_plots(chq_dataplot_t *chart)
+{
+	int error;
+
+	chart->progress = 0;
+
+	chq_dataplot_reduce_begin(chart, chart->reduce);
+	if (chart->store != NULL)
+		error = chq_dataplot_reduce_store(chart, chart->reduce);
+	else
+		error = chq_dataplot_reduce_range(chart, chart->reduce, 0,
+				chart->data_len, 1);
+	if (error == -1)
+		return;
+	chq_reduce_flush(chart->reduce);
+
+	chq_dataplot_draw_reduced(chart, chart->reduce);
+}
+
+
 /**
  * Render the chq_dataplot.
  */
@@ -275,6 +527,115 @@ chq_dataplot_render(chq_dataplot_t *chart, cairo_t *cr)
 }
 
 
+/**
+ * Render the chq_dataplot within about budget seconds, for interactive use.
+ * Each call reduces as many more points as the budget allows and draws
+ * them, completed with a coarse subsample of the points not reached yet,
+ * until the whole data went through the reducer. Returns CHQ_RENDER_MORE
+ * while calling again would refine the picture, CHQ_RENDER_DONE once it is
+ * exact (further calls just redraw it). Call chq_dataplot_restart() after
+ * changing the axes limits. A render interrupted by the cancel callback
+ * draws no data, and the next one starts over.
+ */
+int
+chq_dataplot_render_progressive(chq_dataplot_t *chart, cairo_t *cr,
+		double budget)
+{
+	struct timespec start, now;
+	size_t end, step;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* Stores only read what is in view, there is nothing to refine. */
+	if (chart->store != NULL) {
+		chq_dataplot_render(chart, cr);
+		return CHQ_RENDER_DONE;
+	}
+
+	chart->cr = cr;
+	chq_dataplot_render_axes(chart);
+
+	if (chart->progress == 0)
+		chq_dataplot_reduce_begin(chart, chart->reduce);
+
+	while (chart->progress < chart->data_len) {
+		end = chart->progress + PROGRESS_SLICE;
+		if (end > chart->data_len)
+			end = chart->data_len;
+		/* The slice may be partly fed, start over next time. */
+		if (chq_dataplot_reduce_range(chart, chart->reduce,
+		    chart->progress, end, 1) == -1) {
+			chart->progress = 0;
+			return CHQ_RENDER_MORE;
+		}
+		chart->progress = end;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec) +
+		    (now.tv_nsec - start.tv_nsec) / 1e9 >= budget)
+			break;
+	}
+
+	if (chart->progress == chart->data_len) {
+		chq_reduce_flush(chart->reduce);
+		chq_dataplot_draw_reduced(chart, chart->reduce);
+		return CHQ_RENDER_DONE;
+	}
+
+	/* About four samples per column for what is left. */
+	step = (chart->data_len - chart->progress) /
+		(4.0 * chart->x_axis->size + 1.0) + 1;
+	chq_reduce_copy(chart->preview, chart->reduce);
+	chq_dataplot_reduce_range(chart, chart->preview, chart->progress,
+			chart->data_len, step);
+	chq_reduce_flush(chart->preview);
+	chq_dataplot_draw_reduced(chart, chart->preview);
+
+	return CHQ_RENDER_MORE;
+}
+
+
+/**
+ * Make the next chq_dataplot_render_progressive() start over.
+ */
+void
+chq_dataplot_restart(chq_dataplot_t *chart)
+{
+	chart->progress = 0;
+}
+
+
+/**
+ * Render the chq_dataplot in pixels owned by the caller, width by height
+ * rows of stride bytes in the given format. The pixels are drawn over,
+ * not cleared. Returns 0 on success, -1 if cairo refused the buffer or
+ * failed while drawing.
+ */
+int
+chq_dataplot_render_to_buffer(chq_dataplot_t *chart, uint8_t *pixels,
+		int stride, cairo_format_t format)
+{
+	cairo_surface_t *surface;
+	cairo_status_t status;
+	cairo_t *cr;
+
+	surface = cairo_image_surface_create_for_data(pixels, format,
+			chart->width, chart->height, stride);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return -1;
+	}
+
+	cr = cairo_create(surface);
+	chq_dataplot_render(chart, cr);
+	status = cairo_status(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	return status == CAIRO_STATUS_SUCCESS ? 0 : -1;
+}
+
+
 /**
  * Setter for the chart's global width.
  */
@@ -282,6 +643,7 @@ void
 chq_dataplot_set_width(chq_dataplot_t *chart, unsigned int width)
 {
 	chart->width = width;
+	chart->progress = 0;
 }
 
 
@@ -292,18 +654,75 @@ void
 chq_dataplot_set_height(chq_dataplot_t *chart, unsigned int height)
 {
 	chart->height = height;
+	chart->progress = 0;
 }
 
 
 /**
- * Assign the data arrays.
+ * Draw the data of image surfaces directly in their pixels instead of
+ * going through cairo. Other targets are not affected.
+ */
+void
+chq_dataplot_set_fast_raster(chq_dataplot_t *chart, int fast_raster)
+{
+	chart->fast_raster = fast_raster;
+}
+
+
+/**
+ * Set a callback polled during the data pass, if it returns non-zero the
+ * data is not drawn. Used to abandon renders that became stale.
+ */
+void
+chq_dataplot_set_cancel(chq_dataplot_t *chart, int (*cancel)(void *),
+		void *data)
+{
+	chart->cancel = cancel;
+	chart->cancel_data = data;
+}
+
+
+/**
+ * Assign the data arrays. They are only borrowed, the caller must keep them
+ * alive as long as the chart may be rendered.
  */
 void
 chq_dataplot_set_data(chq_dataplot_t *chart, double *data_x, double *data_y,
 		size_t data_len)
 {
+	chq_buffer_unref(chart->buffer_x);
+	chq_buffer_unref(chart->buffer_y);
+	chart->buffer_x = NULL;
+	chart->buffer_y = NULL;
+
+	chart->store = NULL;
 	chart->data_len = data_len;
 	chart->data_x = data_x;
 	chart->data_y = data_y;
+	chart->type_x = CHQ_COLUMN_DOUBLE;
+	chart->type_y = CHQ_COLUMN_DOUBLE;
+	chart->progress = 0;
 }
 
+
+/**
+ * Assign the data from shared buffers of any column type, the chart holds a
+ * reference on both until it is killed or given other data.
+ */
+void
+chq_dataplot_set_buffers(chq_dataplot_t *chart, chq_buffer_t *buffer_x,
+		chq_buffer_t *buffer_y)
+{
+	chq_buffer_ref(buffer_x);
+	chq_buffer_ref(buffer_y);
+
+	chq_dataplot_set_data(chart, NULL, NULL, buffer_x->len < buffer_y->len ?
+			buffer_x->len : buffer_y->len);
+
+	chart->data_x = buffer_x->data;
+	chart->data_y = buffer_y->data;
+	chart->type_x = buffer_x->type;
+	chart->type_y = buffer_y->type;
+	chart->buffer_x = buffer_x;
+	chart->buffer_y = buffer_y;
+}
@@ -27,12 +27,16 @@ main (int argc, char *argv[])
 	double data_x[] = { 250,  350,  450,  550, 650,  750,  850,   950,  1050,  1150, 1250 };
 	double data_y[] = { 10.1, 20.2, 10.1, 35.1, 40.2, 45.3, 30.35, 20.4, 10.35, 5.3,  1.0 };
 
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+	g_thread_init(NULL);
+#endif
 	gtk_init(&argc, &argv);
 
 	window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 
 	linechart = egg_line_chart_new();
-	egg_line_chart_set_data(linechart, data_x, data_y, data_len);
+	egg_line_chart_set_data(EGG_LINE_CHART(linechart), data_x, data_y,
+	    data_len);
 
 	gtk_container_add(GTK_CONTAINER(window), linechart);
 
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Grids of small charts ("small multiples") drawn on one target. All the
+ * cells have the same size and plot area, so the labels are measured once
+ * for the whole grid:
+ *
+ *  - a shared axis takes its limits and fonts from the grid's own axis, its
+ *    ticks are computed once and its labels drawn once per column (x) or
+ *    row (y), outside the cells;
+ *  - an axis that is not shared stays the cell's own, its labels are drawn
+ *    in every cell but sized on the widest of all the cells.
+ *
+ * On 32 bits image targets drawn without transformation or clip, the cells
+ * are drawn by a few threads, each one on its own surface over the cell's
+ * region of the target's pixels. The regions do not overlap, so no locking
+ * is needed. A chart must not appear in two cells of a grid.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chartesque.h"
+
+#define GRID_MAX_THREADS	16
+
+struct grid_job {
+	chq_grid_t	*grid;
+	/* shared axes, without labels, as seen from the cells */
+	chq_axis_t	*x_axis;
+	chq_axis_t	*y_axis;
+	/* cell geometry */
+	unsigned int	 left;
+	unsigned int	 bottom;
+	unsigned int	 cell_width;
+	unsigned int	 cell_height;
+	double		 plot_left;
+	double		 plot_width;
+	double		 plot_height;
+	/* room for the labels of the axes that are not shared */
+	double		 x_axis_height;
+	double		 y_axis_width;
+	double		 y_label_height;
+	/* target pixels, for the threads */
+	unsigned char	*data;
+	int		 stride;
+	cairo_format_t	 format;
+	unsigned int	 next;
+};
+
+static chq_axis_t	*grid_bare_axis(chq_axis_t *);
+static void		 grid_cell_origin(struct grid_job *, unsigned int,
+				unsigned int *, unsigned int *);
+static void		 grid_measure_cells(struct grid_job *, cairo_t *);
+static void		 grid_render_cell(struct grid_job *, chq_dataplot_t *,
+				cairo_t *);
+static void		*grid_thread(void *);
+static int		 grid_direct(chq_grid_t *, cairo_t *);
+static void		 grid_render_labels(struct grid_job *, cairo_t *);
+
+
+/**
+ * Constructor for a chq_grid of columns by rows empty cells.
+ */
+chq_grid_t *
+chq_grid_new(unsigned int columns, unsigned int rows)
+{
+	chq_grid_t *grid = malloc(sizeof(chq_grid_t));
+
+	grid->width = 800;
+	grid->height = 600;
+	grid->columns = columns;
+	grid->rows = rows;
+	grid->spacing = 4;
+	grid->cells = calloc((size_t)columns * rows, sizeof(chq_dataplot_t *));
+	grid->x_axis = chq_axis_horizontal_new();
+	grid->y_axis = chq_axis_vertical_new();
+	grid->share_x = 0;
+	grid->share_y = 0;
+	grid->labels_as_text = 0;
+	grid->threads = 0;
+
+	return grid;
+}
+
+
+/**
+ * Destructor for chq_grid, the charts of the cells belong to the caller.
+ */
+void
+chq_grid_kill(chq_grid_t *grid)
+{
+	chq_axis_kill(grid->x_axis);
+	chq_axis_kill(grid->y_axis);
+	free(grid->cells);
+	free(grid);
+}
+
+
+/**
+ * Setter for the size of the whole grid, shared labels included.
+ */
+void
+chq_grid_set_size(chq_grid_t *grid, unsigned int width, unsigned int height)
+{
+	grid->width = width;
+	grid->height = height;
+}
+
+
+/**
+ * Put a chart in a cell (NULL empties it). The chart is only borrowed, its
+ * size, margins and axis sizes are replaced by the cell's during the render
+ * and restored afterwards.
+ */
+void
+chq_grid_set_cell(chq_grid_t *grid, unsigned int column, unsigned int row,
+		chq_dataplot_t *chart)
+{
+	if (column >= grid->columns || row >= grid->rows)
+		return;
+	grid->cells[row * grid->columns + column] = chart;
+}
+
+
+/**
+ * Share the x and/or y axes: the cells are then drawn on the limits of the
+ * grid's x_axis and/or y_axis instead of their own.
+ */
+void
+chq_grid_set_shared(chq_grid_t *grid, int x, int y)
+{
+	grid->share_x = x;
+	grid->share_y = y;
+}
+
+
+/**
+ * Return a copy of a prepared shared axis, with the same size and limits,
+ * but no labels, ticks or room for them.
+ */
+static chq_axis_t *
+grid_bare_axis(chq_axis_t *axis)
+{
+	chq_axis_t *bare = chq_axis_copy(axis);
+
+	chq_axis_clear_ticks(bare);
+	bare->label_max_width = 0.0;
+	bare->label_max_height = 0.0;
+	bare->label_padding = 0.0;
+
+	return bare;
+}
+
+
+static void
+grid_cell_origin(struct grid_job *job, unsigned int cell, unsigned int *x,
+		unsigned int *y)
+{
+	chq_grid_t *grid = job->grid;
+
+	*x = job->left + (cell % grid->columns) *
+		(job->cell_width + grid->spacing);
+	*y = (cell / grid->columns) * (job->cell_height + grid->spacing);
+}
+
+
+/**
+ * Size the labels of the axes that are not shared, on the widest and
+ * highest of all the cells, so the plot areas line up.
+ */
+static void
+grid_measure_cells(struct grid_job *job, cairo_t *cr)
+{
+	chq_grid_t *grid = job->grid;
+	chq_dataplot_t *chart;
+	size_t i;
+
+	job->x_axis_height = job->y_axis_width = job->y_label_height = 0.0;
+
+	for (i = 0; i < (size_t)grid->columns * grid->rows; i++) {
+		chart = grid->cells[i];
+		if (chart == NULL)
+			continue;
+		if (!grid->share_x) {
+			chq_axis_calculate_label_size(chart->x_axis, cr);
+			job->x_axis_height = fmax(job->x_axis_height,
+			    chq_axis_horizontal_get_height(chart->x_axis));
+		}
+		if (!grid->share_y) {
+			chq_axis_calculate_label_size(chart->y_axis, cr);
+			job->y_axis_width = fmax(job->y_axis_width,
+			    chq_axis_vertical_get_width(chart->y_axis));
+			job->y_label_height = fmax(job->y_label_height,
+			    chart->y_axis->label_max_height);
+		}
+	}
+}
+
+
+/**
+ * Draw a chart in a cell, cr having its origin on the cell's corner. The
+ * shared axes are swapped in for the render. The chart's size and margins
+ * are restored afterwards, and so are its own axes, ticks included.
+ */
+static void
+grid_render_cell(struct grid_job *job, chq_dataplot_t *chart, cairo_t *cr)
+{
+	chq_dataplot_t saved = *chart;
+	double x_height = chart->x_axis->label_max_height;
+	double x_size = chart->x_axis->size;
+	double y_width = chart->y_axis->label_max_width;
+	double y_height = chart->y_axis->label_max_height;
+	double y_size = chart->y_axis->size;
+
+	chart->cr = cr;
+	chart->width = job->cell_width;
+	chart->height = job->cell_height;
+	chart->margin_top = 0.0;
+	chart->margin_right = 0.0;
+	chart->margin_bottom = 0.0;
+	chart->margin_left = 0.0;
+
+	if (job->grid->share_x) {
+		chart->x_axis = job->x_axis;
+	} else {
+		chart->x_axis->label_max_height = job->x_axis_height -
+			chart->x_axis->label_padding * 2.0;
+		chq_axis_set_size(chart->x_axis, job->plot_width);
+		chq_axis_prerender_ticks(chart->x_axis, cr);
+	}
+
+	if (job->grid->share_y) {
+		chart->y_axis = job->y_axis;
+	} else {
+		chart->y_axis->label_max_width = job->y_axis_width -
+			chart->y_axis->label_padding * 2.0;
+		chart->y_axis->label_max_height = job->y_label_height;
+		chq_axis_set_size(chart->y_axis, job->plot_height);
+		chq_axis_prerender_ticks(chart->y_axis, cr);
+	}
+
+	chq_dataplot_draw_axes(chart);
+	chq_dataplot_render_plots(chart);
+
+	chart->cr = saved.cr;
+	chart->width = saved.width;
+	chart->height = saved.height;
+	chart->margin_top = saved.margin_top;
+	chart->margin_right = saved.margin_right;
+	chart->margin_bottom = saved.margin_bottom;
+	chart->margin_left = saved.margin_left;
+	chart->x_axis = saved.x_axis;
+	chart->y_axis = saved.y_axis;
+
+	if (!job->grid->share_x) {
+		chart->x_axis->label_max_height = x_height;
+		chq_axis_set_size(chart->x_axis, x_size);
+		chq_axis_prerender_ticks(chart->x_axis, cr);
+	}
+	if (!job->grid->share_y) {
+		chart->y_axis->label_max_width = y_width;
+		chart->y_axis->label_max_height = y_height;
+		chq_axis_set_size(chart->y_axis, y_size);
+		chq_axis_prerender_ticks(chart->y_axis, cr);
+	}
+}
+
+
+/**
+ * Worker drawing the next cell nobody took yet, until there is none left.
+ */
+static void *
+grid_thread(void *arg)
+{
+	struct grid_job *job = arg;
+	chq_grid_t *grid = job->grid;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	unsigned int cell, x, y;
+
+	for (;;) {
+		cell = __sync_fetch_and_add(&job->next, 1);
+		if (cell >= grid->columns * grid->rows)
+			break;
+		if (grid->cells[cell] == NULL)
+			continue;
+
+		grid_cell_origin(job, cell, &x, &y);
+		surface = cairo_image_surface_create_for_data(job->data +
+				(size_t)y * job->stride + x * 4, job->format,
+				job->cell_width, job->cell_height, job->stride);
+		cr = cairo_create(surface);
+		grid_render_cell(job, grid->cells[cell], cr);
+		cairo_destroy(cr);
+		cairo_surface_destroy(surface);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Tell if the cells can be drawn straight into the target's pixels: it
+ * must be a 32 bits image surface large enough for the grid, and the user
+ * space must be its pixels, untransformed and unclipped, as for
+ * chq_raster_init().
+ */
+static int
+grid_direct(chq_grid_t *grid, cairo_t *cr)
+{
+	cairo_surface_t *target = cairo_get_target(cr);
+	cairo_matrix_t m;
+	double x0, y0, x1, y1;
+
+	if (cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    (cairo_image_surface_get_format(target) != CAIRO_FORMAT_ARGB32 &&
+	    cairo_image_surface_get_format(target) != CAIRO_FORMAT_RGB24) ||
+	    (unsigned int)cairo_image_surface_get_width(target) <
+	    grid->width ||
+	    (unsigned int)cairo_image_surface_get_height(target) <
+	    grid->height)
+		return 0;
+
+	cairo_get_matrix(cr, &m);
+	if (m.xx != 1.0 || m.yy != 1.0 || m.xy != 0.0 || m.yx != 0.0 ||
+	    m.x0 != 0.0 || m.y0 != 0.0)
+		return 0;
+	cairo_surface_get_device_offset(target, &x0, &y0);
+	if (x0 != 0.0 || y0 != 0.0)
+		return 0;
+	cairo_clip_extents(cr, &x0, &y0, &x1, &y1);
+	if (x0 > 0.0 || y0 > 0.0 ||
+	    x1 < cairo_image_surface_get_width(target) ||
+	    y1 < cairo_image_surface_get_height(target))
+		return 0;
+
+	return 1;
+}
+
+
+/**
+ * Draw the labels of the shared axes: the x ones under each column, the y
+ * ones left of each row.
+ */
+static void
+grid_render_labels(struct grid_job *job, cairo_t *cr)
+{
+	chq_grid_t *grid = job->grid;
+	chq_dataplot_t strip;
+	unsigned int i, x, y;
+
+	memset(&strip, 0, sizeof(strip));
+	strip.cr = cr;
+	strip.labels_as_text = grid->labels_as_text;
+
+	cairo_save(cr);
+	cairo_new_path(cr);
+	cairo_set_source_rgb(cr, 0, 0, 0);
+
+	if (grid->share_x) {
+		strip.x_axis = grid->x_axis;
+		strip.y_axis = job->y_axis;
+		strip.margin_left = job->plot_left;
+		strip.height = job->bottom;
+		y = grid->rows * (job->cell_height + grid->spacing) -
+			grid->spacing;
+		for (i = 0; i < grid->columns; i++) {
+			x = job->left + i * (job->cell_width + grid->spacing);
+			cairo_save(cr);
+			cairo_translate(cr, x, y);
+			chq_dataplot_render_x_axis_labels(&strip);
+			cairo_restore(cr);
+		}
+	}
+
+	if (grid->share_y) {
+		strip.x_axis = job->x_axis;
+		strip.y_axis = grid->y_axis;
+		strip.margin_left = 0.0;
+		for (i = 0; i < grid->rows; i++) {
+			grid_cell_origin(job, i * grid->columns, &x, &y);
+			cairo_save(cr);
+			cairo_translate(cr, 0, y);
+			chq_dataplot_render_y_axis_labels(&strip);
+			cairo_restore(cr);
+		}
+	}
+
+	cairo_fill(cr);
+	cairo_restore(cr);
+}
+
+
+/**
+ * Render the grid: the labels of the shared axes, then every cell with its
+ * data. The target is drawn over, not cleared. Image targets in ARGB32 or
+ * RGB24 get their cells drawn in parallel (see grid_direct()), with one
+ * thread per CPU unless grid->threads says otherwise. The calling thread
+ * takes cells too, so the ones a thread that failed to start would have
+ * drawn are drawn inline.
+ */
+void
+chq_grid_render(chq_grid_t *grid, cairo_t *cr)
+{
+	pthread_t threads[GRID_MAX_THREADS];
+	cairo_surface_t *target = cairo_get_target(cr);
+	struct grid_job job;
+	unsigned int i, count, started, cells, x, y;
+	double width, height;
+	long ncpu;
+
+	cells = grid->columns * grid->rows;
+	if (cells == 0)
+		return;
+
+	memset(&job, 0, sizeof(job));
+	job.grid = grid;
+
+	/* The shared axes are measured once, for the whole grid. */
+	if (grid->share_x) {
+		chq_axis_calculate_label_size(grid->x_axis, cr);
+		job.bottom = ceil(
+		    chq_axis_horizontal_get_height(grid->x_axis));
+	}
+	if (grid->share_y) {
+		chq_axis_calculate_label_size(grid->y_axis, cr);
+		job.left = ceil(chq_axis_vertical_get_width(grid->y_axis));
+	}
+	grid_measure_cells(&job, cr);
+
+	width = ((double)grid->width - job.left - grid->spacing *
+		(grid->columns - 1.0)) / grid->columns;
+	height = ((double)grid->height - job.bottom - grid->spacing *
+		(grid->rows - 1.0)) / grid->rows;
+	if (width < 1.0 || height < 1.0)
+		return;
+	job.cell_width = width;
+	job.cell_height = height;
+
+	/* Plot area within a cell. */
+	job.plot_left = grid->share_y ? 0.0 : job.y_axis_width;
+	job.plot_width = job.cell_width - job.plot_left;
+	job.plot_height = job.cell_height - (grid->share_x ? 0.0 :
+		job.x_axis_height);
+
+	chq_axis_set_size(grid->x_axis, job.plot_width);
+	chq_axis_set_size(grid->y_axis, job.plot_height);
+	if (grid->share_x)
+		chq_axis_prerender_ticks(grid->x_axis, cr);
+	if (grid->share_y)
+		chq_axis_prerender_ticks(grid->y_axis, cr);
+	job.x_axis = grid_bare_axis(grid->x_axis);
+	job.y_axis = grid_bare_axis(grid->y_axis);
+
+	if (grid_direct(grid, cr)) {
+		cairo_surface_flush(target);
+		job.data = cairo_image_surface_get_data(target);
+		job.stride = cairo_image_surface_get_stride(target);
+		job.format = cairo_image_surface_get_format(target);
+
+		count = grid->threads;
+		if (count == 0) {
+			ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+			count = ncpu < 1 ? 1 : ncpu;
+		}
+		if (count > GRID_MAX_THREADS)
+			count = GRID_MAX_THREADS;
+		if (count > cells)
+			count = cells;
+
+		for (started = 0; started + 1 < count; started++)
+			if (pthread_create(&threads[started], NULL,
+			    grid_thread, &job) != 0)
+				break;
+		grid_thread(&job);
+		for (i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+
+		cairo_surface_mark_dirty(target);
+	} else {
+		for (i = 0; i < cells; i++) {
+			if (grid->cells[i] == NULL)
+				continue;
+			grid_cell_origin(&job, i, &x, &y);
+			cairo_save(cr);
+			cairo_translate(cr, x, y);
+			cairo_rectangle(cr, 0, 0, job.cell_width,
+			    job.cell_height);
+			cairo_clip(cr);
+			grid_render_cell(&job, grid->cells[i], cr);
+			cairo_restore(cr);
+		}
+	}
+
+	grid_render_labels(&job, cr);
+
+	chq_axis_kill(job.x_axis);
+	chq_axis_kill(job.y_axis);
+}
+
+
+/**
+ * Render the grid in pixels owned by the caller, like
+ * chq_dataplot_render_to_buffer(). Returns 0 on success, -1 if cairo
+ * refused the buffer or failed while drawing.
+ */
+int
+chq_grid_render_to_buffer(chq_grid_t *grid, uint8_t *pixels, int stride,
+		cairo_format_t format)
+{
+	cairo_surface_t *surface;
+	cairo_status_t status;
+	cairo_t *cr;
+
+	surface = cairo_image_surface_create_for_data(pixels, format,
+			grid->width, grid->height, stride);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return -1;
+	}
+
+	cr = cairo_create(surface);
+	chq_grid_render(grid, cr);
+	status = cairo_status(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	return status == CAIRO_STATUS_SUCCESS ? 0 : -1;
+}
@@ -21,86 +21,405 @@
 #include "chartesque.h"
 #include "string.h"
 
+/*
+ * The chart is rendered on a worker thread into image surfaces, the
+ * expose handler only paints the last completed frame (scaled to the
+ * current allocation). Every new job bumps the generation, which makes
+ * older jobs give up as soon as they notice.
+ */
+struct render_job {
+	EggLineChart	*chart;
+	gint		 generation;
+	gint		 width;
+	gint		 height;
+	chq_buffer_t	*buffer_x;
+	chq_buffer_t	*buffer_y;
+	chq_dataplot_t	*result;
+};
+
+struct render_frame {
+	EggLineChart	*chart;
+	gint		 generation;
+	cairo_surface_t	*surface;
+};
+
+/* Time given to the first pass of a render, then to each refinement. */
+#define RENDER_BUDGET_FIRST	(1.0 / 60.0)
+#define RENDER_BUDGET_REFINE	0.1
+
+/* Distance in pixels within which the pointer hovers a point. */
+#define HOVER_RADIUS		8.0
+
+enum {
+	POINT_HOVER,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 G_DEFINE_TYPE(EggLineChart, egg_line_chart, GTK_TYPE_DRAWING_AREA);
 
 static gboolean egg_line_chart_expose(GtkWidget *, GdkEventExpose *);
-static void draw(GtkWidget *widget, cairo_t *cr);
+static gboolean egg_line_chart_motion(GtkWidget *, GdkEventMotion *);
+static gboolean egg_line_chart_leave(GtkWidget *, GdkEventCrossing *);
+static void set_hover(EggLineChart *, glong);
+static void egg_line_chart_finalize(GObject *);
+static void queue_render(EggLineChart *, gint, gint);
+static int render_cancelled(void *);
+static void render_thread(gpointer, gpointer);
+static gboolean render_frame_done(gpointer);
+static gboolean render_job_done(gpointer);
+static chq_dataplot_t *new_chart(struct render_job *);
 
 static void
 egg_line_chart_class_init(EggLineChartClass *class)
 {
+	GObjectClass *object_class;
 	GtkWidgetClass *widget_class;
 
+	object_class = G_OBJECT_CLASS(class);
 	widget_class = GTK_WIDGET_CLASS(class);
 
+	object_class->finalize = egg_line_chart_finalize;
 	widget_class->expose_event = egg_line_chart_expose;
+	widget_class->motion_notify_event = egg_line_chart_motion;
+	widget_class->leave_notify_event = egg_line_chart_leave;
+
+	/*
+	 * Emitted when the pointer moves near a point of the data, with its
+	 * index (see egg_line_chart_get_point), or away from it with -1.
+	 */
+	signals[POINT_HOVER] = g_signal_new("point-hover",
+	    G_TYPE_FROM_CLASS(class), G_SIGNAL_RUN_LAST,
+	    G_STRUCT_OFFSET(EggLineChartClass, point_hover), NULL, NULL,
+	    g_cclosure_marshal_VOID__LONG, G_TYPE_NONE, 1, G_TYPE_LONG);
 }
 
 static void
 egg_line_chart_init(EggLineChart *chart)
 {
+	chart->render_pool = g_thread_pool_new(render_thread, NULL, 1, FALSE,
+	    NULL);
+	chart->hover_index = -1;
+
+	gtk_widget_add_events(GTK_WIDGET(chart), GDK_POINTER_MOTION_MASK |
+	    GDK_POINTER_MOTION_HINT_MASK | GDK_LEAVE_NOTIFY_MASK);
+}
+
+static void
+egg_line_chart_finalize(GObject *object)
+{
+	EggLineChart *chart = EGG_LINE_CHART(object);
+
+	/* Jobs hold a reference, none can be left at this point. */
+	g_thread_pool_free(chart->render_pool, TRUE, TRUE);
+
+	if (chart->frame != NULL)
+		cairo_surface_destroy(chart->frame);
+	chq_buffer_unref(chart->buffer_x);
+	chq_buffer_unref(chart->buffer_y);
+	if (chart->pick_chart != NULL)
+		chq_dataplot_kill(chart->pick_chart);
+
+	G_OBJECT_CLASS(egg_line_chart_parent_class)->finalize(object);
 }
 
 static gboolean
-egg_line_chart_expose(GtkWidget *chart, GdkEventExpose *event)
+egg_line_chart_expose(GtkWidget *widget, GdkEventExpose *event)
 {
+	EggLineChart *chart = EGG_LINE_CHART(widget);
+	gint width, height;
 	cairo_t *cr;
 
-	cr = gdk_cairo_create(chart->window);
+	width = widget->allocation.width;
+	height = widget->allocation.height;
+
+	if (chart->data_dirty || width != chart->queued_width ||
+	    height != chart->queued_height)
+		queue_render(chart, width, height);
+
+	if (chart->frame == NULL)
+		return FALSE;
+
+	cr = gdk_cairo_create(widget->window);
+	gdk_cairo_region(cr, event->region);
+	cairo_clip(cr);
 
-	draw(chart, cr);
+	cairo_scale(cr,
+	    (double)width / cairo_image_surface_get_width(chart->frame),
+	    (double)height / cairo_image_surface_get_height(chart->frame));
+	cairo_set_source_surface(cr, chart->frame, 0, 0);
+	cairo_paint(cr);
 
 	cairo_destroy(cr);
 
 	return FALSE;
 }
 
+/*
+ * Look up the point under the pointer in the last completed chart, mapping
+ * the pointer back to that chart's size if the widget was resized since.
+ */
+static gboolean
+egg_line_chart_motion(GtkWidget *widget, GdkEventMotion *event)
+{
+	EggLineChart *chart = EGG_LINE_CHART(widget);
+	chq_dataplot_t *pick_chart = chart->pick_chart;
+	gint x, y;
+	size_t index;
+
+	gdk_window_get_pointer(widget->window, &x, &y, NULL);
+
+	if (pick_chart == NULL || widget->allocation.width <= 0 ||
+	    widget->allocation.height <= 0)
+		return FALSE;
+
+	if (chq_dataplot_pick(pick_chart,
+	    (double)x * pick_chart->width / widget->allocation.width,
+	    (double)y * pick_chart->height / widget->allocation.height,
+	    HOVER_RADIUS, &index) == 0)
+		set_hover(chart, index);
+	else
+		set_hover(chart, -1);
+
+	return FALSE;
+}
+
+static gboolean
+egg_line_chart_leave(GtkWidget *widget, GdkEventCrossing *event)
+{
+	set_hover(EGG_LINE_CHART(widget), -1);
+
+	return FALSE;
+}
+
+static void
+set_hover(EggLineChart *chart, glong index)
+{
+	if (index == chart->hover_index)
+		return;
+
+	chart->hover_index = index;
+	g_signal_emit(chart, signals[POINT_HOVER], 0, index);
+}
+
 GtkWidget *
 egg_line_chart_new(void)
 {
 	return g_object_new(EGG_TYPE_LINE_CHART, NULL);
 }
 
+/*
+ * Copy the data into new buffers, the arrays can be freed afterwards.
+ */
 void
 egg_line_chart_set_data(EggLineChart *chart, double *data_x, double *data_y, size_t data_len)
 {
-	chart->data_x = calloc(data_len, sizeof(double));
-	if (chart->data_x == NULL) {
+	chq_buffer_t *buffer_x, *buffer_y;
+
+	buffer_x = chq_buffer_new(data_x, data_len);
+	buffer_y = chq_buffer_new(data_y, data_len);
+
+	if (buffer_x != NULL && buffer_y != NULL)
+		egg_line_chart_set_buffers(chart, buffer_x, buffer_y);
+
+	chq_buffer_unref(buffer_x);
+	chq_buffer_unref(buffer_y);
+}
+
+/*
+ * Share the data of existing buffers, the widget keeps a reference on them
+ * until it is destroyed or given other data.
+ */
+void
+egg_line_chart_set_buffers(EggLineChart *chart, chq_buffer_t *buffer_x,
+    chq_buffer_t *buffer_y)
+{
+	chq_buffer_ref(buffer_x);
+	chq_buffer_ref(buffer_y);
+	chq_buffer_unref(chart->buffer_x);
+	chq_buffer_unref(chart->buffer_y);
+
+	chart->buffer_x = buffer_x;
+	chart->buffer_y = buffer_y;
+	chart->data_dirty = TRUE;
+
+	gtk_widget_queue_draw(GTK_WIDGET(chart));
+}
+
+/*
+ * Get the values of the point at index in the current data, returns FALSE
+ * if there is no such point.
+ */
+gboolean
+egg_line_chart_get_point(EggLineChart *chart, glong index, double *x,
+    double *y)
+{
+	if (chart->buffer_x == NULL || index < 0 ||
+	    (size_t)index >= chart->buffer_x->len ||
+	    (size_t)index >= chart->buffer_y->len)
+		return FALSE;
+
+	*x = chq_column_get(chart->buffer_x->type, chart->buffer_x->data,
+	    index);
+	*y = chq_column_get(chart->buffer_y->type, chart->buffer_y->data,
+	    index);
+
+	return TRUE;
+}
+
+/*
+ * Hand a render of the current data at the given size to the worker, this
+ * makes any job still queued or running stale.
+ */
+static void
+queue_render(EggLineChart *chart, gint width, gint height)
+{
+	struct render_job *job;
+
+	chart->data_dirty = FALSE;
+	chart->queued_width = width;
+	chart->queued_height = height;
+
+	if (width <= 0 || height <= 0 || chart->buffer_x == NULL)
 		return;
+
+	g_atomic_int_inc(&chart->generation);
+
+	job = g_new0(struct render_job, 1);
+	job->chart = g_object_ref(chart);
+	job->generation = g_atomic_int_get(&chart->generation);
+	job->width = width;
+	job->height = height;
+	job->buffer_x = chq_buffer_ref(chart->buffer_x);
+	job->buffer_y = chq_buffer_ref(chart->buffer_y);
+
+	g_thread_pool_push(chart->render_pool, job, NULL);
+}
+
+static int
+render_cancelled(void *data)
+{
+	struct render_job *job = data;
+
+	return g_atomic_int_get(&job->chart->generation) != job->generation;
+}
+
+/*
+ * Render progressively: the first pass is kept within a frame time so
+ * something shows up right away, the following ones refine it in larger
+ * steps. Every pass is handed to the main loop as a new frame, unless the
+ * job was cancelled during it: the pass stopped halfway through the data.
+ */
+static void
+render_thread(gpointer data, gpointer user_data)
+{
+	struct render_job *job = data;
+	struct render_frame *frame;
+	chq_dataplot_t *chart;
+	double budget = RENDER_BUDGET_FIRST;
+	int status = CHQ_RENDER_MORE;
+	cairo_t *cr;
+
+	chart = new_chart(job);
+
+	while (status == CHQ_RENDER_MORE && !render_cancelled(job)) {
+		frame = g_new0(struct render_frame, 1);
+		frame->chart = g_object_ref(job->chart);
+		frame->generation = job->generation;
+		frame->surface = cairo_image_surface_create(
+		    CAIRO_FORMAT_ARGB32, job->width, job->height);
+
+		cr = cairo_create(frame->surface);
+		status = chq_dataplot_render_progressive(chart, cr, budget);
+		cairo_destroy(cr);
+		budget = RENDER_BUDGET_REFINE;
+
+		if (render_cancelled(job)) {
+			cairo_surface_destroy(frame->surface);
+			g_object_unref(frame->chart);
+			g_free(frame);
+			break;
+		}
+
+		g_idle_add(render_frame_done, frame);
 	}
-	chart->data_y = calloc(data_len, sizeof(double));
-	if (chart->data_y == NULL) {
-		return;
+
+	/* A complete chart is kept by the widget to answer hover queries. */
+	if (status == CHQ_RENDER_DONE && !render_cancelled(job)) {
+		chq_dataplot_set_cancel(chart, NULL, NULL);
+		chq_dataplot_pick_prepare(chart);
+		job->result = chart;
+	} else {
+		chq_dataplot_kill(chart);
+	}
+
+	g_idle_add(render_job_done, job);
+}
+
+/*
+ * Back on the main loop, show the frame unless a newer one is already
+ * displayed.
+ */
+static gboolean
+render_frame_done(gpointer data)
+{
+	struct render_frame *frame = data;
+	EggLineChart *chart = frame->chart;
+
+	if (chart->frame == NULL ||
+	    frame->generation >= chart->frame_generation) {
+		if (chart->frame != NULL)
+			cairo_surface_destroy(chart->frame);
+		chart->frame = frame->surface;
+		chart->frame_generation = frame->generation;
+		gtk_widget_queue_draw(GTK_WIDGET(chart));
+	} else {
+		cairo_surface_destroy(frame->surface);
 	}
 
-	memcpy(chart->data_y, data_y, data_len * sizeof(double));
-	memcpy(chart->data_x, data_x, data_len * sizeof(double));
+	g_object_unref(chart);
+	g_free(frame);
 
-	chart->data_len = data_len;
+	return FALSE;
 }
 
-static void
-draw(GtkWidget *widget, cairo_t *cr)
+static gboolean
+render_job_done(gpointer data)
 {
-	EggLineChart	*chart_widget;
-	guint		 width, height;
+	struct render_job *job = data;
+	EggLineChart *chart = job->chart;
+
+	if (job->result != NULL && job->generation >= chart->pick_generation) {
+		if (chart->pick_chart != NULL)
+			chq_dataplot_kill(chart->pick_chart);
+		chart->pick_chart = job->result;
+		chart->pick_generation = job->generation;
+	} else if (job->result != NULL) {
+		chq_dataplot_kill(job->result);
+	}
 
-	chart_widget = EGG_LINE_CHART(widget);
+	chq_buffer_unref(job->buffer_x);
+	chq_buffer_unref(job->buffer_y);
+	g_object_unref(job->chart);
+	g_free(job);
 
-	width = widget->allocation.width;
-	height = widget->allocation.height;
+	return FALSE;
+}
 
+static chq_dataplot_t *
+new_chart(struct render_job *job)
+{
 	chq_dataplot_t *chart = chq_dataplot_new();
-	chq_dataplot_set_width(chart, width);
-	chq_dataplot_set_height(chart, height);
+	chq_dataplot_set_width(chart, job->width);
+	chq_dataplot_set_height(chart, job->height);
 
-	chq_dataplot_set_data(chart, chart_widget->data_x,
-		chart_widget->data_y, chart_widget->data_len);
+	chq_dataplot_set_buffers(chart, job->buffer_x, job->buffer_y);
+	chq_dataplot_set_fast_raster(chart, 1);
+	chq_dataplot_set_cancel(chart, render_cancelled, job);
 
 	chq_axis_set_limit(chart->x_axis, 200, 2000);
 	chq_axis_set_limit(chart->y_axis, 1, 50);
 
-	chq_dataplot_render(chart, cr);
-
-	chq_dataplot_kill(chart);
+	return chart;
 }
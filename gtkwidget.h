@@ -20,6 +20,8 @@
 
 #include <gtk/gtk.h>
 
+#include "chartesque.h"
+
 G_BEGIN_DECLS
 
 #define EGG_TYPE_LINE_CHART		(egg_line_chart_get_type ())
@@ -38,17 +40,35 @@ struct _EggLineChart
 
 	/* < private > */
 
-	double		*data_x;
-	double		*data_y;
-	size_t		 data_len;
+	chq_buffer_t	*buffer_x;
+	chq_buffer_t	*buffer_y;
+	gboolean	 data_dirty;
+
+	/* rendering happens on a worker thread */
+	GThreadPool	*render_pool;
+	volatile gint	 generation;
+	gint		 queued_width;
+	gint		 queued_height;
+	cairo_surface_t	*frame;
+	gint		 frame_generation;
+
+	/* last completed chart, kept for hit-testing */
+	chq_dataplot_t	*pick_chart;
+	gint		 pick_generation;
+	glong		 hover_index;
 };
 
 struct _EggLineChartClass
 {
 	GtkDrawingAreaClass parent_class;
+
+	void (* point_hover) (EggLineChart *, glong);
 };
 
 GtkWidget *egg_line_chart_new (void);
+void egg_line_chart_set_data (EggLineChart *, double *, double *, size_t);
+void egg_line_chart_set_buffers (EggLineChart *, chq_buffer_t *, chq_buffer_t *);
+gboolean egg_line_chart_get_point (EggLineChart *, glong, double *, double *);
 
 G_END_DECLS
 
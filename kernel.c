@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Kernels of the data pass, converting the points to device coordinates and
+ * feeding them to a reducer (and the overlays). Each one is generated by
+ * KERNEL() for a combination of:
+ *
+ *  - the type of the X and Y columns: double, float or int64_t;
+ *  - NaN handling: points with a NaN are skipped, or the data is known to
+ *    have none and nothing is checked;
+ *  - overlays: fed with every point, or absent.
+ *
+ * chq_kernel_setup() picks one per pass and folds both axes into a scale and
+ * an offset, so the loop has no orientation switch, no division and no test
+ * that is known in advance.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "chartesque.h"
+
+typedef size_t (*kernel_run_t)(const chq_kernel_t *, chq_reduce_t *,
+		const void *, const void *, size_t, size_t, size_t);
+
+/*
+ * Feed every step-th point from start to end (excluded), returns the number
+ * of points skipped for a NaN.
+ */
+#define KERNEL(name, x_type, y_type, check_nan, with_overlays)		\
+static size_t								\
+name(const chq_kernel_t *kernel, chq_reduce_t *reduce,			\
+		const void *x_column, const void *y_column, size_t start, \
+		size_t end, size_t step)				\
+{									\
+	const x_type *data_x = x_column;				\
+	const y_type *data_y = y_column;				\
+	const double x_scale = kernel->x_scale;				\
+	const double x_offset = kernel->x_offset;			\
+	const double y_scale = kernel->y_scale;				\
+	const double y_offset = kernel->y_offset;			\
+	chq_overlay_t *overlay;						\
+	size_t i, skipped = 0;						\
+	double x, y;							\
+									\
+	for (i = start; i < end; i += step) {				\
+		x = data_x[i] * x_scale + x_offset;			\
+		y = data_y[i] * y_scale + y_offset;			\
+		if (check_nan && (isnan(x) || isnan(y))) {		\
+			skipped++;					\
+			continue;					\
+		}							\
+		chq_reduce_push(reduce, x, y);				\
+		if (with_overlays)					\
+			for (overlay = kernel->overlays;		\
+			    overlay != NULL; overlay = overlay->next)	\
+				chq_overlay_push(overlay, x, y);	\
+	}								\
+									\
+	return skipped;							\
+}
+
+/* The four kernels of a pair of column types. */
+#define KERNELS(x_name, x_type, y_name, y_type)				\
+KERNEL(kernel_##x_name##_##y_name, x_type, y_type, 1, 0)		\
+KERNEL(kernel_##x_name##_##y_name##_finite, x_type, y_type, 0, 0)	\
+KERNEL(kernel_##x_name##_##y_name##_overlays, x_type, y_type, 1, 1)	\
+KERNEL(kernel_##x_name##_##y_name##_finite_overlays, x_type, y_type, 0, 1)
+
+KERNELS(double, double,		double, double)
+KERNELS(double, double,		float, float)
+KERNELS(double, double,		int64, int64_t)
+KERNELS(float, float,		double, double)
+KERNELS(float, float,		float, float)
+KERNELS(float, float,		int64, int64_t)
+KERNELS(int64, int64_t,		double, double)
+KERNELS(int64, int64_t,		float, float)
+KERNELS(int64, int64_t,		int64, int64_t)
+
+/* Same order as KERNELS(), indexed by finite + 2 * with_overlays. */
+#define KERNEL_ENTRIES(x_name, y_name)					\
+	{ { #x_name "_" #y_name, kernel_##x_name##_##y_name },		\
+	  { #x_name "_" #y_name "_finite",				\
+	    kernel_##x_name##_##y_name##_finite },			\
+	  { #x_name "_" #y_name "_overlays",				\
+	    kernel_##x_name##_##y_name##_overlays },			\
+	  { #x_name "_" #y_name "_finite_overlays",			\
+	    kernel_##x_name##_##y_name##_finite_overlays } }
+
+/* Indexed by enum column_type of X, then of Y. */
+static const struct kernel_entry {
+	const char	*name;
+	kernel_run_t	 run;
+} kernels[CHQ_COLUMN_TYPES][CHQ_COLUMN_TYPES][4] = {
+	{ KERNEL_ENTRIES(double, double),
+	  KERNEL_ENTRIES(double, float),
+	  KERNEL_ENTRIES(double, int64) },
+	{ KERNEL_ENTRIES(float, double),
+	  KERNEL_ENTRIES(float, float),
+	  KERNEL_ENTRIES(float, int64) },
+	{ KERNEL_ENTRIES(int64, double),
+	  KERNEL_ENTRIES(int64, float),
+	  KERNEL_ENTRIES(int64, int64) },
+};
+
+
+/**
+ * Prepare a kernel for the current axes and margins of chart, reading
+ * columns of type_x and type_y. The overlays are fed if not NULL. finite
+ * says the data has no NaN: the points are not checked, which is only safe
+ * if both axes have a size (a zero size turns infinite values into NaN).
+ */
+void
+chq_kernel_setup(chq_kernel_t *kernel, chq_dataplot_t *chart,
+		chq_overlay_t *overlays, enum column_type type_x,
+		enum column_type type_y, int finite)
+{
+	chq_axis_t *x_axis = chart->x_axis, *y_axis = chart->y_axis;
+	double left = chart->margin_left + chq_axis_vertical_get_width(y_axis);
+	double top = chart->margin_top;
+	const struct kernel_entry *entry;
+
+	/* chq_axis_convert_to_scale() as value * scale + offset. */
+	kernel->x_scale = x_axis->size / chq_axis_get_spread(x_axis);
+	kernel->x_offset = left - x_axis->limit_min * kernel->x_scale;
+	kernel->y_scale = -y_axis->size / chq_axis_get_spread(y_axis);
+	kernel->y_offset = top + y_axis->size -
+		y_axis->limit_min * kernel->y_scale;
+	kernel->overlays = overlays;
+
+	if (finite && (x_axis->size <= 0.0 || y_axis->size <= 0.0))
+		finite = 0;
+
+	entry = &kernels[type_x][type_y][(finite ? 1 : 0) +
+		(overlays != NULL ? 2 : 0)];
+	kernel->name = entry->name;
+	kernel->run = entry->run;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Layouts hold everything a chart computes before its data pass: label
+ * sizes, axes sizes, ticks and the plot area. Charts sharing a size,
+ * margins, limits and fonts can be rendered against one layout, in which
+ * case only their data is drawn per chart.
+ */
+
+#include <stdlib.h>
+
+#include "chartesque.h"
+
+
+/**
+ * Constructor for a chq_layout, computed from the configuration of chart.
+ * The cairo context is used to measure the labels. If its target is an
+ * image surface, the axes are also drawn once on a frame surface which is
+ * then painted under each chart.
+ */
+chq_layout_t *
+chq_layout_new(chq_dataplot_t *chart, cairo_t *cr)
+{
+	chq_layout_t *layout = malloc(sizeof(chq_layout_t));
+	cairo_surface_t *target = cairo_get_target(cr);
+	cairo_t *frame_cr;
+
+	chart->cr = cr;
+	chq_dataplot_prepare_axes(chart);
+
+	layout->width = chart->width;
+	layout->height = chart->height;
+	layout->margin_top = chart->margin_top;
+	layout->margin_right = chart->margin_right;
+	layout->margin_bottom = chart->margin_bottom;
+	layout->margin_left = chart->margin_left;
+	layout->x_axis = chq_axis_copy(chart->x_axis);
+	layout->y_axis = chq_axis_copy(chart->y_axis);
+
+	layout->plot_left = chart->margin_left +
+		chq_axis_vertical_get_width(layout->y_axis);
+	layout->plot_top = chart->margin_top;
+	layout->plot_width = layout->x_axis->size;
+	layout->plot_height = layout->y_axis->size;
+
+	layout->frame = NULL;
+	if (cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE) {
+		layout->frame = cairo_surface_create_similar(target,
+				CAIRO_CONTENT_COLOR_ALPHA, chart->width,
+				chart->height);
+		frame_cr = cairo_create(layout->frame);
+		chart->cr = frame_cr;
+		chq_dataplot_draw_axes(chart);
+		cairo_destroy(frame_cr);
+		chart->cr = cr;
+	}
+
+	return layout;
+}
+
+
+/**
+ * Destructor for chq_layout.
+ */
+void
+chq_layout_kill(chq_layout_t *layout)
+{
+	chq_axis_kill(layout->x_axis);
+	chq_axis_kill(layout->y_axis);
+	if (layout->frame != NULL)
+		cairo_surface_destroy(layout->frame);
+	free(layout);
+}
+
+
+/**
+ * Render the chq_dataplot against a layout: the frame (or the axes from the
+ * layout's ticks) then the data. The chart takes the size and margins of
+ * the layout, and its data is scaled on the layout's axes, its own axes
+ * are left untouched.
+ */
+void
+chq_dataplot_render_layout(chq_dataplot_t *chart, chq_layout_t *layout,
+		cairo_t *cr)
+{
+	chq_axis_t *x_axis = chart->x_axis, *y_axis = chart->y_axis;
+
+	chart->cr = cr;
+	chart->width = layout->width;
+	chart->height = layout->height;
+	chart->margin_top = layout->margin_top;
+	chart->margin_right = layout->margin_right;
+	chart->margin_bottom = layout->margin_bottom;
+	chart->margin_left = layout->margin_left;
+	chart->x_axis = layout->x_axis;
+	chart->y_axis = layout->y_axis;
+
+	if (layout->frame != NULL) {
+		cairo_save(cr);
+		cairo_set_source_surface(cr, layout->frame, 0, 0);
+		cairo_paint(cr);
+		cairo_restore(cr);
+	} else {
+		chq_dataplot_draw_axes(chart);
+	}
+
+	chq_dataplot_render_plots(chart);
+
+	chart->x_axis = x_axis;
+	chart->y_axis = y_axis;
+}
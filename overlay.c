@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Rolling window statistics drawn over the data, computed in the same pass
+ * as the data itself. Points are pushed in device coordinates, as for the
+ * reducer, and every statistic is taken over the last window points:
+ *
+ *  - the envelope keeps monotonic deques of the window, so the lowest and
+ *    highest values are known in constant amortized time per point;
+ *  - the mean keeps a running sum;
+ *  - the percentiles keep a histogram with one bin per device unit of the
+ *    plot height, and a cursor per percentile that only moves by the few
+ *    bins the window shifts at each point. They are exact to the pixel.
+ *
+ * The results go through reducers of their own, so an overlay costs the
+ * same memory whatever the number of points. NaN are left out.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chartesque.h"
+
+static unsigned int	overlay_bin(chq_overlay_t *, double);
+static void		overlay_cursor_add(struct chq_overlay_cursor *,
+				unsigned int, int);
+static double		overlay_cursor_get(chq_overlay_t *,
+				struct chq_overlay_cursor *);
+static void		overlay_outline(chq_overlay_t *);
+
+
+/**
+ * Constructor for a chq_overlay over the last window points, NULL if there
+ * is not enough memory.
+ */
+chq_overlay_t *
+chq_overlay_new(enum overlay_type type, size_t window)
+{
+	chq_overlay_t *overlay = calloc(1, sizeof(chq_overlay_t));
+
+	if (overlay == NULL)
+		return NULL;
+
+	overlay->type = type;
+	overlay->window = window > 0 ? window : 1;
+	overlay->lower_q = 0.1;
+	overlay->upper_q = 0.9;
+
+	overlay->values = malloc(sizeof(double) * overlay->window);
+	overlay->min_deque = malloc(sizeof(size_t) * overlay->window);
+	overlay->max_deque = malloc(sizeof(size_t) * overlay->window);
+	overlay->upper = chq_reduce_new();
+	overlay->lower = chq_reduce_new();
+	overlay->shown_upper = chq_reduce_new();
+	overlay->shown_lower = chq_reduce_new();
+	overlay->outline = chq_reduce_new();
+	if (overlay->values == NULL || overlay->min_deque == NULL ||
+	    overlay->max_deque == NULL || overlay->upper == NULL ||
+	    overlay->lower == NULL || overlay->shown_upper == NULL ||
+	    overlay->shown_lower == NULL || overlay->outline == NULL) {
+		chq_overlay_kill(overlay);
+		return NULL;
+	}
+
+	return overlay;
+}
+
+
+/**
+ * Destructor for chq_overlay.
+ */
+void
+chq_overlay_kill(chq_overlay_t *overlay)
+{
+	free(overlay->values);
+	free(overlay->min_deque);
+	free(overlay->max_deque);
+	free(overlay->histogram);
+	if (overlay->upper != NULL)
+		chq_reduce_kill(overlay->upper);
+	if (overlay->lower != NULL)
+		chq_reduce_kill(overlay->lower);
+	if (overlay->shown_upper != NULL)
+		chq_reduce_kill(overlay->shown_upper);
+	if (overlay->shown_lower != NULL)
+		chq_reduce_kill(overlay->shown_lower);
+	if (overlay->outline != NULL)
+		chq_reduce_kill(overlay->outline);
+	free(overlay);
+}
+
+
+/**
+ * Set the band of a CHQ_OVERLAY_PERCENTILES overlay, as fractions between
+ * 0 and 1 (0.1 and 0.9 by default).
+ */
+void
+chq_overlay_set_percentiles(chq_overlay_t *overlay, double lower_q,
+		double upper_q)
+{
+	overlay->lower_q = lower_q < 0.0 ? 0.0 : lower_q > 1.0 ? 1.0 : lower_q;
+	overlay->upper_q = upper_q < 0.0 ? 0.0 : upper_q > 1.0 ? 1.0 : upper_q;
+}
+
+
+/**
+ * Drop all the points and start over. The outputs are reduced with the
+ * given resolution and precision (see chq_reduce_reset), the histogram of
+ * the percentiles covers height units from top.
+ */
+void
+chq_overlay_begin(chq_overlay_t *overlay, double resolution,
+		double precision, double top, double height)
+{
+	unsigned int bins;
+	unsigned int *histogram;
+
+	chq_reduce_reset(overlay->upper, resolution, precision);
+	chq_reduce_reset(overlay->lower, resolution, precision);
+	overlay->count = 0;
+	overlay->seq = 0;
+	overlay->sum = 0.0;
+	overlay->min_head = overlay->min_len = 0;
+	overlay->max_head = overlay->max_len = 0;
+
+	if (overlay->type != CHQ_OVERLAY_PERCENTILES)
+		return;
+
+	overlay->bin_top = top;
+	overlay->bin_size = resolution > 0.0 ? resolution : 1.0;
+	bins = ceil(height / overlay->bin_size);
+	if (bins == 0)
+		bins = 1;
+
+	if (bins > overlay->bins) {
+		histogram = realloc(overlay->histogram,
+				sizeof(unsigned int) * bins);
+		if (histogram == NULL) {
+			overlay->bins = 0;
+			return;
+		}
+		overlay->histogram = histogram;
+	}
+	overlay->bins = bins;
+	memset(overlay->histogram, 0, sizeof(unsigned int) * bins);
+	memset(&overlay->lower_cursor, 0, sizeof(overlay->lower_cursor));
+	memset(&overlay->upper_cursor, 0, sizeof(overlay->upper_cursor));
+}
+
+
+/**
+ * Histogram bin of a device ordinate, out of range values go to the ends.
+ */
+static unsigned int
+overlay_bin(chq_overlay_t *overlay, double y)
+{
+	double bin = (y - overlay->bin_top) / overlay->bin_size;
+
+	if (bin < 0.0)
+		return 0;
+	if (bin >= overlay->bins)
+		return overlay->bins - 1;
+	return bin;
+}
+
+
+/**
+ * Keep the count of values below the cursor in sync with the histogram.
+ */
+static void
+overlay_cursor_add(struct chq_overlay_cursor *cursor, unsigned int bin,
+		int delta)
+{
+	if (bin < cursor->bin)
+		cursor->below += delta;
+}
+
+
+/**
+ * Move the cursor to the bin holding its percentile of the window and
+ * return the ordinate of that bin's center.
+ */
+static double
+overlay_cursor_get(chq_overlay_t *overlay, struct chq_overlay_cursor *cursor)
+{
+	double q = cursor == &overlay->lower_cursor ? overlay->lower_q :
+		overlay->upper_q;
+	size_t rank = q * (overlay->count - 1);
+
+	while (cursor->below > rank) {
+		cursor->bin--;
+		cursor->below -= overlay->histogram[cursor->bin];
+	}
+	while (cursor->below + overlay->histogram[cursor->bin] <= rank) {
+		cursor->below += overlay->histogram[cursor->bin];
+		cursor->bin++;
+	}
+
+	return overlay->bin_top + (cursor->bin + 0.5) * overlay->bin_size;
+}
+
+
+/**
+ * Feed a point, in device coordinates.
+ */
+void
+chq_overlay_push(chq_overlay_t *overlay, double x, double y)
+{
+	size_t window = overlay->window, seq = overlay->seq;
+	size_t slot = seq % window, back;
+	unsigned int bin;
+	double old;
+
+	if (isnan(x) || isnan(y))
+		return;
+	if (overlay->type == CHQ_OVERLAY_PERCENTILES && overlay->bins == 0)
+		return;
+
+	/* The value leaving the window. */
+	if (overlay->count == window) {
+		old = overlay->values[slot];
+		overlay->sum -= old;
+		if (overlay->type == CHQ_OVERLAY_PERCENTILES) {
+			bin = overlay_bin(overlay, old);
+			overlay->histogram[bin]--;
+			overlay_cursor_add(&overlay->lower_cursor, bin, -1);
+			overlay_cursor_add(&overlay->upper_cursor, bin, -1);
+		}
+	} else {
+		overlay->count++;
+	}
+	overlay->values[slot] = y;
+	overlay->sum += y;
+	overlay->seq++;
+
+	switch (overlay->type) {
+	case CHQ_OVERLAY_ENVELOPE:
+		/* Expired heads, then the tails this value dominates. */
+		if (overlay->min_len > 0 &&
+		    overlay->min_deque[overlay->min_head] + window <= seq) {
+			overlay->min_head = (overlay->min_head + 1) % window;
+			overlay->min_len--;
+		}
+		if (overlay->max_len > 0 &&
+		    overlay->max_deque[overlay->max_head] + window <= seq) {
+			overlay->max_head = (overlay->max_head + 1) % window;
+			overlay->max_len--;
+		}
+		while (overlay->min_len > 0) {
+			back = (overlay->min_head + overlay->min_len - 1) %
+				window;
+			if (overlay->values[overlay->min_deque[back] % window]
+			    < y)
+				break;
+			overlay->min_len--;
+		}
+		while (overlay->max_len > 0) {
+			back = (overlay->max_head + overlay->max_len - 1) %
+				window;
+			if (overlay->values[overlay->max_deque[back] % window]
+			    > y)
+				break;
+			overlay->max_len--;
+		}
+		overlay->min_deque[(overlay->min_head + overlay->min_len) %
+			window] = seq;
+		overlay->min_len++;
+		overlay->max_deque[(overlay->max_head + overlay->max_len) %
+			window] = seq;
+		overlay->max_len++;
+
+		chq_reduce_push(overlay->upper, x, overlay->values[
+			overlay->min_deque[overlay->min_head] % window]);
+		chq_reduce_push(overlay->lower, x, overlay->values[
+			overlay->max_deque[overlay->max_head] % window]);
+		break;
+	case CHQ_OVERLAY_MEAN:
+		chq_reduce_push(overlay->upper, x, overlay->sum /
+				overlay->count);
+		break;
+	case CHQ_OVERLAY_PERCENTILES:
+		bin = overlay_bin(overlay, y);
+		overlay->histogram[bin]++;
+		overlay_cursor_add(&overlay->lower_cursor, bin, 1);
+		overlay_cursor_add(&overlay->upper_cursor, bin, 1);
+
+		chq_reduce_push(overlay->upper, x, overlay_cursor_get(overlay,
+				&overlay->upper_cursor));
+		chq_reduce_push(overlay->lower, x, overlay_cursor_get(overlay,
+				&overlay->lower_cursor));
+		break;
+	}
+}
+
+
+/**
+ * Take a flushed copy of the outputs for drawing, leaving the overlay
+ * ready for more points. Bands also get their closed outline: the upper
+ * side forward, then the lower side backward.
+ */
+void
+chq_overlay_snapshot(chq_overlay_t *overlay)
+{
+	chq_reduce_copy(overlay->shown_upper, overlay->upper);
+	chq_reduce_flush(overlay->shown_upper);
+
+	if (overlay->type == CHQ_OVERLAY_MEAN)
+		return;
+
+	chq_reduce_copy(overlay->shown_lower, overlay->lower);
+	chq_reduce_flush(overlay->shown_lower);
+	overlay_outline(overlay);
+}
+
+
+static void
+overlay_outline(chq_overlay_t *overlay)
+{
+	chq_reduce_t *outline = overlay->outline;
+	chq_reduce_t *upper = overlay->shown_upper;
+	chq_reduce_t *lower = overlay->shown_lower;
+	size_t i, len = upper->len + lower->len;
+	double *x, *y;
+
+	outline->len = 0;
+	if (len > outline->size) {
+		x = realloc(outline->x, sizeof(double) * len);
+		if (x == NULL)
+			return;
+		outline->x = x;
+		y = realloc(outline->y, sizeof(double) * len);
+		if (y == NULL)
+			return;
+		outline->y = y;
+		outline->size = len;
+	}
+
+	memcpy(outline->x, upper->x, sizeof(double) * upper->len);
+	memcpy(outline->y, upper->y, sizeof(double) * upper->len);
+	for (i = 0; i < lower->len; i++) {
+		outline->x[upper->len + i] = lower->x[lower->len - 1 - i];
+		outline->y[upper->len + i] = lower->y[lower->len - 1 - i];
+	}
+	outline->len = len;
+}
+
+
+/**
+ * Add an overlay of the given type over the last window points of the
+ * chart's data. The chart owns it, it is returned so its settings can be
+ * changed. Returns NULL if there is not enough memory.
+ */
+chq_overlay_t *
+chq_dataplot_add_overlay(chq_dataplot_t *chart, enum overlay_type type,
+		size_t window)
+{
+	chq_overlay_t *overlay, **last;
+
+	overlay = chq_overlay_new(type, window);
+	if (overlay == NULL)
+		return NULL;
+
+	for (last = &chart->overlays; *last != NULL; last = &(*last)->next)
+		;
+	*last = overlay;
+	chart->progress = 0;
+
+	return overlay;
+}
+
+
+/**
+ * Remove all the overlays of the chart.
+ */
+void
+chq_dataplot_clear_overlays(chq_dataplot_t *chart)
+{
+	chq_overlay_t *overlay, *next;
+
+	for (overlay = chart->overlays; overlay != NULL; overlay = next) {
+		next = overlay->next;
+		chq_overlay_kill(overlay);
+	}
+	chart->overlays = NULL;
+	chart->progress = 0;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Nearest point queries, in chart coordinates, for hovering. When the X
+ * values are sorted, the points around the query are found by binary
+ * search. When there are too many of them, or the data is a scatter, a
+ * grid with one cell per pixel of the plot area is built on first use;
+ * each cell remembers the point closest to its center, so the answer is
+ * exact to the pixel.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "chartesque.h"
+
+/* Above this many candidates around the query, use the grid. */
+#define PICK_SCAN_MAX	4096
+
+#define PICK_EMPTY	SIZE_MAX
+
+static int	pick_is_current(chq_dataplot_t *, chq_pick_t *);
+static int	pick_sorted(chq_dataplot_t *);
+static void	pick_update(chq_dataplot_t *);
+static int	pick_build_grid(chq_dataplot_t *, chq_pick_t *);
+static double	pick_x(chq_dataplot_t *, size_t);
+static double	pick_y(chq_dataplot_t *, size_t);
+static size_t	pick_lower_bound(chq_dataplot_t *, double);
+
+
+/**
+ * Destructor for a chq_pick.
+ */
+void
+chq_pick_kill(chq_pick_t *pick)
+{
+	if (pick == NULL)
+		return;
+	free(pick->grid);
+	free(pick);
+}
+
+
+/**
+ * Values of the point at index of the chart's data.
+ */
+static double
+pick_x(chq_dataplot_t *chart, size_t index)
+{
+	return chq_column_get(chart->type_x, chart->data_x, index);
+}
+
+
+static double
+pick_y(chq_dataplot_t *chart, size_t index)
+{
+	return chq_column_get(chart->type_y, chart->data_y, index);
+}
+
+
+/**
+ * Tell if the index was built for the chart's current data and geometry.
+ */
+static int
+pick_is_current(chq_dataplot_t *chart, chq_pick_t *pick)
+{
+	return pick->data_x == chart->data_x &&
+		pick->data_y == chart->data_y &&
+		pick->data_len == chart->data_len &&
+		pick->x_size == chart->x_axis->size &&
+		pick->y_size == chart->y_axis->size &&
+		pick->x_min == chart->x_axis->limit_min &&
+		pick->x_max == chart->x_axis->limit_max &&
+		pick->y_min == chart->y_axis->limit_min &&
+		pick->y_max == chart->y_axis->limit_max;
+}
+
+
+/**
+ * Tell if the X values can be binary searched: sorted, without NaN since
+ * they compare to nothing.
+ */
+static int
+pick_sorted(chq_dataplot_t *chart)
+{
+	size_t i;
+
+	if (chart->data_len > 0 && isnan(pick_x(chart, 0)))
+		return 0;
+	for (i = 1; i < chart->data_len; i++)
+		if (!(pick_x(chart, i) >= pick_x(chart, i - 1)))
+			return 0;
+
+	return 1;
+}
+
+
+/**
+ * Reset the index if the chart changed since it was built, the sortedness
+ * is checked once per data set: by chq_dataplot_pick_prepare() if it was
+ * called, else by the first query.
+ */
+static void
+pick_update(chq_dataplot_t *chart)
+{
+	chq_pick_t *pick = chart->pick;
+
+	if (pick == NULL) {
+		pick = calloc(1, sizeof(chq_pick_t));
+		if (pick == NULL)
+			return;
+		chart->pick = pick;
+	} else if (pick_is_current(chart, pick)) {
+		return;
+	}
+
+	if (pick->data_x != chart->data_x ||
+	    pick->data_len != chart->data_len)
+		pick->sorted = pick_sorted(chart);
+
+	free(pick->grid);
+	pick->grid = NULL;
+
+	pick->data_x = chart->data_x;
+	pick->data_y = chart->data_y;
+	pick->data_len = chart->data_len;
+	pick->x_size = chart->x_axis->size;
+	pick->y_size = chart->y_axis->size;
+	pick->x_min = chart->x_axis->limit_min;
+	pick->x_max = chart->x_axis->limit_max;
+	pick->y_min = chart->y_axis->limit_min;
+	pick->y_max = chart->y_axis->limit_max;
+}
+
+
+/**
+ * Fill the grid with the point nearest to the center of each cell. Returns
+ * -1 if the grid could not be allocated.
+ */
+static int
+pick_build_grid(chq_dataplot_t *chart, chq_pick_t *pick)
+{
+	size_t i, cell, cells;
+	double x, y, d;
+	int col, row;
+
+	pick->grid_width = pick->x_size > 0 ? ceil(pick->x_size) : 0;
+	pick->grid_height = pick->y_size > 0 ? ceil(pick->y_size) : 0;
+	cells = (size_t)pick->grid_width * pick->grid_height;
+	if (cells == 0)
+		return -1;
+
+	pick->grid = malloc(sizeof(size_t) * cells);
+	if (pick->grid == NULL)
+		return -1;
+	for (cell = 0; cell < cells; cell++)
+		pick->grid[cell] = PICK_EMPTY;
+
+	for (i = 0; i < chart->data_len; i++) {
+		x = chq_axis_convert_to_scale(chart->x_axis, pick_x(chart, i));
+		y = chq_axis_convert_to_scale(chart->y_axis, pick_y(chart, i));
+		if (!(x >= 0.0 && x < pick->grid_width && y >= 0.0 &&
+		    y < pick->grid_height))
+			continue;
+
+		col = x;
+		row = y;
+		cell = (size_t)row * pick->grid_width + col;
+		if (pick->grid[cell] != PICK_EMPTY) {
+			d = hypot(x - col - 0.5, y - row - 0.5);
+			if (d >= hypot(chq_axis_convert_to_scale(chart->x_axis,
+			    pick_x(chart, pick->grid[cell])) - col - 0.5,
+			    chq_axis_convert_to_scale(chart->y_axis,
+			    pick_y(chart, pick->grid[cell])) - row - 0.5))
+				continue;
+		}
+		pick->grid[cell] = i;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Build the index now rather than on the first query, e.g. on a worker
+ * thread: the X values are checked for sortedness and the grid is built,
+ * the queries that follow only search. The axes must have been prepared by
+ * a render.
+ */
+void
+chq_dataplot_pick_prepare(chq_dataplot_t *chart)
+{
+	pick_update(chart);
+	if (chart->pick != NULL && chart->pick->grid == NULL)
+		pick_build_grid(chart, chart->pick);
+}
+
+
+/**
+ * Return the index of the first X value of the chart, sorted, not below
+ * value.
+ */
+static size_t
+pick_lower_bound(chq_dataplot_t *chart, double value)
+{
+	size_t low = 0, high = chart->data_len, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (pick_x(chart, mid) < value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+/**
+ * Find the point nearest to (px, py), in the coordinates the chart was last
+ * rendered with, within radius. Its position in the data is set on *index
+ * and 0 is returned, -1 if there is no point that close.
+ */
+int
+chq_dataplot_pick(chq_dataplot_t *chart, double px, double py,
+		double radius, size_t *index)
+{
+	chq_pick_t *pick;
+	double x, y, best = INFINITY, d, left, top, from, to;
+	size_t i, start, end, found = PICK_EMPTY, cell;
+	int col, row, col_min, col_max, row_min, row_max;
+
+	pick_update(chart);
+	pick = chart->pick;
+	if (pick == NULL || chart->data_len == 0)
+		return -1;
+
+	left = chart->margin_left + chq_axis_vertical_get_width(chart->y_axis);
+	top = chart->margin_top;
+	x = px - left;
+	y = py - top;
+
+	if (pick->sorted) {
+		from = chq_axis_convert_from_scale(chart->x_axis, x - radius);
+		to = chq_axis_convert_from_scale(chart->x_axis, x + radius);
+		start = pick_lower_bound(chart, from < to ? from : to);
+		end = pick_lower_bound(chart, from < to ? to : from);
+		while (end < chart->data_len &&
+		    pick_x(chart, end) <= (from < to ? to : from))
+			end++;
+
+		if (end - start <= PICK_SCAN_MAX) {
+			for (i = start; i < end; i++) {
+				d = hypot(chq_axis_convert_to_scale(
+				    chart->x_axis, pick_x(chart, i)) - x,
+				    chq_axis_convert_to_scale(chart->y_axis,
+				    pick_y(chart, i)) - y);
+				if (d <= radius && d < best) {
+					best = d;
+					found = i;
+				}
+			}
+			goto done;
+		}
+	}
+
+	if (pick->grid == NULL && pick_build_grid(chart, pick) == -1)
+		return -1;
+
+	col_min = floor(x - radius);
+	col_max = ceil(x + radius);
+	row_min = floor(y - radius);
+	row_max = ceil(y + radius);
+	if (col_min < 0)
+		col_min = 0;
+	if (row_min < 0)
+		row_min = 0;
+	if (col_max > pick->grid_width)
+		col_max = pick->grid_width;
+	if (row_max > pick->grid_height)
+		row_max = pick->grid_height;
+
+	for (row = row_min; row < row_max; row++) {
+		for (col = col_min; col < col_max; col++) {
+			cell = (size_t)row * pick->grid_width + col;
+			if (pick->grid[cell] == PICK_EMPTY)
+				continue;
+			i = pick->grid[cell];
+			d = hypot(chq_axis_convert_to_scale(chart->x_axis,
+			    pick_x(chart, i)) - x,
+			    chq_axis_convert_to_scale(chart->y_axis,
+			    pick_y(chart, i)) - y);
+			if (d <= radius && d < best) {
+				best = d;
+				found = i;
+			}
+		}
+	}
+
+done:
+	if (found == PICK_EMPTY)
+		return -1;
+
+	*index = found;
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A small pool of image surfaces and their contexts, for callers rendering
+ * many charts of the same size without owning the pixels. Reusing an entry
+ * saves allocating (and faulting in) a new buffer and creating a context.
+ * A pool is not thread-safe, use one per thread.
+ */
+
+#include <stdlib.h>
+
+#include "chartesque.h"
+
+static void	pool_entry_clear(chq_pool_entry_t *);
+
+
+/**
+ * Constructor for a chq_pool holding at most size surfaces.
+ */
+chq_pool_t *
+chq_pool_new(unsigned int size)
+{
+	chq_pool_t *pool = malloc(sizeof(chq_pool_t));
+
+	pool->size = size;
+	pool->clock = 0;
+	pool->entries = calloc(size, sizeof(chq_pool_entry_t));
+
+	return pool;
+}
+
+
+static void
+pool_entry_clear(chq_pool_entry_t *entry)
+{
+	if (entry->cr != NULL)
+		cairo_destroy(entry->cr);
+	if (entry->surface != NULL)
+		cairo_surface_destroy(entry->surface);
+	entry->cr = NULL;
+	entry->surface = NULL;
+	entry->busy = 0;
+}
+
+
+/**
+ * Destructor for chq_pool, contexts still acquired are destroyed as well.
+ */
+void
+chq_pool_kill(chq_pool_t *pool)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->size; i++)
+		pool_entry_clear(&pool->entries[i]);
+	free(pool->entries);
+	free(pool);
+}
+
+
+/**
+ * Return a context on an image surface of the given format and size,
+ * reusing a released one if possible. A reused surface is cleared to
+ * transparent unless full_frame is set, in which case the caller promises
+ * to paint every pixel and gets it back as it was left. The context must
+ * be given back with chq_pool_release(), its target is valid until then.
+ */
+cairo_t *
+chq_pool_acquire(chq_pool_t *pool, cairo_format_t format, int width,
+		int height, int full_frame)
+{
+	chq_pool_entry_t *entry, *victim = NULL;
+	cairo_surface_t *surface;
+	unsigned int i;
+
+	for (i = 0; i < pool->size; i++) {
+		entry = &pool->entries[i];
+		if (entry->busy)
+			continue;
+		if (entry->surface != NULL && entry->format == format &&
+		    entry->width == width && entry->height == height) {
+			entry->busy = 1;
+			entry->used = ++pool->clock;
+
+			if (!full_frame) {
+				cairo_save(entry->cr);
+				cairo_set_operator(entry->cr,
+				    CAIRO_OPERATOR_CLEAR);
+				cairo_paint(entry->cr);
+				cairo_restore(entry->cr);
+			}
+			cairo_save(entry->cr);
+
+			return entry->cr;
+		}
+		if (victim == NULL || entry->surface == NULL ||
+		    (victim->surface != NULL && entry->used < victim->used))
+			victim = entry;
+	}
+
+	surface = cairo_image_surface_create(format, width, height);
+
+	/* Every entry is busy, hand out a context the pool won't keep. */
+	if (victim == NULL)
+		return cairo_create(surface);
+
+	pool_entry_clear(victim);
+	victim->surface = surface;
+	victim->cr = cairo_create(surface);
+	victim->format = format;
+	victim->width = width;
+	victim->height = height;
+	victim->busy = 1;
+	victim->used = ++pool->clock;
+	cairo_save(victim->cr);
+
+	return victim->cr;
+}
+
+
+/**
+ * Give back a context obtained with chq_pool_acquire(), its state and path
+ * are reset for the next user.
+ */
+void
+chq_pool_release(chq_pool_t *pool, cairo_t *cr)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->size; i++) {
+		if (pool->entries[i].cr == cr) {
+			cairo_restore(cr);
+			cairo_new_path(cr);
+			pool->entries[i].busy = 0;
+			return;
+		}
+	}
+
+	cairo_surface_destroy(cairo_get_target(cr));
+	cairo_destroy(cr);
+}
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Software rasterizer for the data pass, writing straight into the pixels
+ * of an ARGB32 image surface. It only knows how to fill and stroke the
+ * polyline held by a chq_reduce, with a single opaque color, which is all
+ * the data pass needs. It has its own rectangular clip, set by
+ * chq_raster_clip(); targets already clipped by cairo are left to cairo.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "chartesque.h"
+
+/* Vertical samples per pixel row for the fill. */
+#define RASTER_SUBSAMPLES	4
+/* Edges entering a sample above which the crossings are sorted anew. */
+#define RASTER_SORT_ENTERED	16
+
+struct raster_edge {
+	double	 x0, y0;
+	double	 y1;
+	double	 dxdy;
+	int	 dir;
+};
+
+struct raster_crossing {
+	double	 x;
+	int	 dir;
+	size_t	 edge;
+};
+
+static uint32_t	raster_pixel(uint32_t, unsigned int, unsigned int,
+		    unsigned int, unsigned int);
+static int	raster_edge_cmp(const void *, const void *);
+static int	raster_crossing_cmp(const void *, const void *);
+static void	raster_sort_crossings(struct raster_crossing *, size_t);
+static void	raster_span(float *, float *, int, double, double, float);
+
+
+/**
+ * Prepare to draw on the target of cr. Returns 0 if the fast path can be
+ * used, that is if the target is an ARGB32 image surface, the user space
+ * is the surface's pixels (no transformation, no device offset) and
+ * nothing is clipped, -1 otherwise.
+ */
+int
+chq_raster_init(chq_raster_t *raster, cairo_t *cr)
+{
+	cairo_surface_t *surface = cairo_get_target(cr);
+	cairo_matrix_t m;
+	double x0, y0, x1, y1;
+
+	if (cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32)
+		return -1;
+
+	cairo_get_matrix(cr, &m);
+	if (m.xx != 1.0 || m.yy != 1.0 || m.xy != 0.0 || m.yx != 0.0 ||
+	    m.x0 != 0.0 || m.y0 != 0.0)
+		return -1;
+	cairo_surface_get_device_offset(surface, &x0, &y0);
+	if (x0 != 0.0 || y0 != 0.0)
+		return -1;
+
+	raster->width = cairo_image_surface_get_width(surface);
+	raster->height = cairo_image_surface_get_height(surface);
+	cairo_clip_extents(cr, &x0, &y0, &x1, &y1);
+	if (x0 > 0.0 || y0 > 0.0 || x1 < raster->width ||
+	    y1 < raster->height)
+		return -1;
+
+	cairo_surface_flush(surface);
+
+	raster->surface = surface;
+	raster->data = cairo_image_surface_get_data(surface);
+	raster->stride = cairo_image_surface_get_stride(surface);
+	raster->clip_x0 = 0;
+	raster->clip_y0 = 0;
+	raster->clip_x1 = raster->width;
+	raster->clip_y1 = raster->height;
+
+	return raster->data == NULL ? -1 : 0;
+}
+
+
+/**
+ * Restrict the drawing to a rectangle, rounded to whole pixels.
+ */
+void
+chq_raster_clip(chq_raster_t *raster, double x, double y, double width,
+		double height)
+{
+	raster->clip_x0 = fmin(fmax(round(x), 0.0), raster->width);
+	raster->clip_y0 = fmin(fmax(round(y), 0.0), raster->height);
+	raster->clip_x1 = fmax(fmin(round(x + width), raster->width),
+	    raster->clip_x0);
+	raster->clip_y1 = fmax(fmin(round(y + height), raster->height),
+	    raster->clip_y0);
+}
+
+
+/**
+ * Tell cairo the pixels were modified behind its back.
+ */
+void
+chq_raster_done(chq_raster_t *raster)
+{
+	cairo_surface_mark_dirty(raster->surface);
+}
+
+
+/**
+ * Blend an opaque color over a premultiplied pixel with the given coverage
+ * (0 to 255).
+ */
+static uint32_t
+raster_pixel(uint32_t dst, unsigned int r, unsigned int g, unsigned int b,
+		unsigned int coverage)
+{
+	unsigned int inv = 255 - coverage;
+	unsigned int da = dst >> 24, dr = (dst >> 16) & 0xff;
+	unsigned int dg = (dst >> 8) & 0xff, db = dst & 0xff;
+
+	da = (255 * coverage + da * inv + 127) / 255;
+	dr = (r * coverage + dr * inv + 127) / 255;
+	dg = (g * coverage + dg * inv + 127) / 255;
+	db = (b * coverage + db * inv + 127) / 255;
+
+	return da << 24 | dr << 16 | dg << 8 | db;
+}
+
+
+static int
+raster_edge_cmp(const void *a, const void *b)
+{
+	const struct raster_edge *ea = a, *eb = b;
+
+	return ea->y0 < eb->y0 ? -1 : ea->y0 > eb->y0;
+}
+
+
+static int
+raster_crossing_cmp(const void *a, const void *b)
+{
+	const struct raster_crossing *ca = a, *cb = b;
+
+	return ca->x < cb->x ? -1 : ca->x > cb->x;
+}
+
+
+/**
+ * Sort crossings by x. They are in the order of the previous sample, which
+ * is nearly sorted already, hence the insertion sort.
+ */
+static void
+raster_sort_crossings(struct raster_crossing *crossings, size_t len)
+{
+	struct raster_crossing c;
+	size_t i, j;
+
+	for (i = 1; i < len; i++) {
+		c = crossings[i];
+		for (j = i; j > 0 && crossings[j - 1].x > c.x; j--)
+			crossings[j] = crossings[j - 1];
+		crossings[j] = c;
+	}
+}
+
+
+/**
+ * Add the horizontal span [xa, xb) to a row of coverage. Partial pixels at
+ * both ends go to cover, the full pixels in between are accumulated as a
+ * difference in run and summed up by the caller.
+ */
+static void
+raster_span(float *cover, float *run, int width, double xa, double xb,
+		float weight)
+{
+	int ia, ib;
+
+	/* NaN would pass the clamps below and index anywhere. */
+	if (xa != xa || xb != xb)
+		return;
+	if (xa < 0.0)
+		xa = 0.0;
+	if (xb > width)
+		xb = width;
+	if (xb <= xa)
+		return;
+
+	ia = (int)xa;
+	ib = (int)xb;
+
+	if (ia == ib) {
+		cover[ia] += (xb - xa) * weight;
+		return;
+	}
+
+	cover[ia] += (ia + 1 - xa) * weight;
+	run[ia + 1] += weight;
+	run[ib] -= weight;
+	if (ib < width)
+		cover[ib] += (xb - ib) * weight;
+}
+
+
+/**
+ * Fill the closed polygon of the reduced points with the non-zero winding
+ * rule, like cairo_fill() does by default. The polygon is scanned with a
+ * few samples per row and each row is blended as soon as it is complete.
+ * Only the edges crossing a sample are visited, kept in the order of their
+ * crossings from one sample to the next.
+ */
+void
+chq_raster_fill(chq_raster_t *raster, chq_reduce_t *reduce, double r,
+		double g, double b)
+{
+	struct raster_edge *edges, *e;
+	struct raster_crossing *crossings;
+	size_t i, j, edges_len = 0, next = 0, crossings_len = 0, entered;
+	float *cover, *run, acc;
+	double x0, y0, x1, y1, ys, ymin = INFINITY, ymax = -INFINITY;
+	int row, row_min, row_max, s, col, winding;
+	unsigned int red = r * 255, green = g * 255, blue = b * 255;
+	unsigned int coverage;
+	uint32_t *pixels;
+
+	if (reduce->len < 3)
+		return;
+
+	edges = malloc(sizeof(struct raster_edge) * reduce->len);
+	crossings = malloc(sizeof(struct raster_crossing) * reduce->len);
+	cover = calloc(raster->width + 1, sizeof(float));
+	run = calloc(raster->width + 1, sizeof(float));
+	if (edges == NULL || crossings == NULL || cover == NULL ||
+	    run == NULL)
+		goto done;
+
+	for (i = 0; i < reduce->len; i++) {
+		x0 = reduce->x[i];
+		y0 = reduce->y[i];
+		x1 = reduce->x[(i + 1) % reduce->len];
+		y1 = reduce->y[(i + 1) % reduce->len];
+		if (y0 == y1 || !isfinite(x0) || !isfinite(y0) ||
+		    !isfinite(x1) || !isfinite(y1))
+			continue;
+
+		e = &edges[edges_len++];
+		e->dir = y0 < y1 ? 1 : -1;
+		if (y0 > y1) {
+			e->x0 = x1;
+			e->y0 = y1;
+			e->y1 = y0;
+		} else {
+			e->x0 = x0;
+			e->y0 = y0;
+			e->y1 = y1;
+		}
+		e->dxdy = (x1 - x0) / (y1 - y0);
+		if (!isfinite(e->dxdy)) {
+			edges_len--;
+			continue;
+		}
+
+		if (e->y0 < ymin)
+			ymin = e->y0;
+		if (e->y1 > ymax)
+			ymax = e->y1;
+	}
+	if (edges_len == 0)
+		goto done;
+
+	qsort(edges, edges_len, sizeof(struct raster_edge), raster_edge_cmp);
+
+	row_min = fmin(fmax(floor(ymin), raster->clip_y0), raster->clip_y1);
+	row_max = fmax(fmin(ceil(ymax), raster->clip_y1), raster->clip_y0);
+
+	for (row = row_min; row < row_max; row++) {
+		for (s = 0; s < RASTER_SUBSAMPLES; s++) {
+			ys = row + (s + 0.5) / RASTER_SUBSAMPLES;
+
+			/* Drop the edges above, keeping the order. */
+			for (i = j = 0; i < crossings_len; i++)
+				if (edges[crossings[i].edge].y1 > ys)
+					crossings[j++] = crossings[i];
+			crossings_len = j;
+
+			/* Edges are sorted by top, add the ones reached. */
+			entered = crossings_len;
+			for (; next < edges_len && edges[next].y0 <= ys;
+			    next++) {
+				if (edges[next].y1 <= ys)
+					continue;
+				crossings[crossings_len].dir =
+					edges[next].dir;
+				crossings[crossings_len].edge = next;
+				crossings_len++;
+			}
+
+			for (i = 0; i < crossings_len; i++) {
+				e = &edges[crossings[i].edge];
+				crossings[i].x = e->x0 + (ys - e->y0) *
+					e->dxdy;
+			}
+			if (crossings_len - entered > RASTER_SORT_ENTERED)
+				qsort(crossings, crossings_len,
+				    sizeof(struct raster_crossing),
+				    raster_crossing_cmp);
+			else
+				raster_sort_crossings(crossings,
+				    crossings_len);
+
+			winding = 0;
+			for (j = 0; j < crossings_len; j++) {
+				if (winding != 0)
+					raster_span(cover, run, raster->width,
+					    crossings[j - 1].x, crossings[j].x,
+					    1.0f / RASTER_SUBSAMPLES);
+				winding += crossings[j].dir;
+			}
+		}
+
+		pixels = (uint32_t *)(raster->data + row * raster->stride);
+		acc = 0.0f;
+		for (col = 0; col < raster->width; col++) {
+			acc += run[col];
+			coverage = (acc + cover[col]) * 255.0f + 0.5f;
+			if (coverage > 255)
+				coverage = 255;
+			if (coverage > 0 && col >= raster->clip_x0 &&
+			    col < raster->clip_x1)
+				pixels[col] = raster_pixel(pixels[col], red,
+				    green, blue, coverage);
+			cover[col] = 0.0f;
+			run[col] = 0.0f;
+		}
+		run[raster->width] = 0.0f;
+	}
+
+done:
+	free(edges);
+	free(crossings);
+	free(cover);
+	free(run);
+}
+
+
+/**
+ * Stroke the open polyline of the reduced points. The coverage of each
+ * pixel is derived from its distance to the nearest segment, kept as the
+ * maximum over all segments so joints are not blended twice, then the
+ * whole mask is blended at once.
+ */
+void
+chq_raster_stroke(chq_raster_t *raster, chq_reduce_t *reduce, double width,
+		double r, double g, double b)
+{
+	double radius = width / 2.0 + 0.5, radius2 = radius * radius;
+	double x0, y0, x1, y1, dx, dy, len2, t, px, py, qx, qy, d2, d;
+	double xl, hx = 0.0, left, right, seg_left, seg_right;
+	double bx0 = INFINITY, by0 = INFINITY, bx1 = -INFINITY;
+	double by1 = -INFINITY;
+	int mx, my, mw, mh, row, col, col_min, col_max, row_min, row_max;
+	unsigned int red = r * 255, green = g * 255, blue = b * 255;
+	unsigned int coverage;
+	unsigned char *mask;
+	uint32_t *pixels;
+	size_t i;
+
+	if (reduce->len < 2)
+		return;
+
+	for (i = 0; i < reduce->len; i++) {
+		if (!isfinite(reduce->x[i]) || !isfinite(reduce->y[i]))
+			continue;
+		if (reduce->x[i] < bx0)
+			bx0 = reduce->x[i];
+		if (reduce->x[i] > bx1)
+			bx1 = reduce->x[i];
+		if (reduce->y[i] < by0)
+			by0 = reduce->y[i];
+		if (reduce->y[i] > by1)
+			by1 = reduce->y[i];
+	}
+
+	/* The mask only covers the stroke's bounding box. */
+	if (bx0 > bx1)
+		return;
+	if (bx0 - radius >= raster->clip_x1 ||
+	    by0 - radius >= raster->clip_y1)
+		return;
+	mx = fmax(floor(bx0 - radius), raster->clip_x0);
+	my = fmax(floor(by0 - radius), raster->clip_y0);
+	mw = fmax(fmin(ceil(bx1 + radius), raster->clip_x1), mx) - mx;
+	mh = fmax(fmin(ceil(by1 + radius), raster->clip_y1), my) - my;
+	if (mw <= 0 || mh <= 0)
+		return;
+
+	mask = calloc((size_t)mw * mh, 1);
+	if (mask == NULL)
+		return;
+
+	for (i = 0; i + 1 < reduce->len; i++) {
+		x0 = reduce->x[i];
+		y0 = reduce->y[i];
+		x1 = reduce->x[i + 1];
+		y1 = reduce->y[i + 1];
+		if (!isfinite(x0) || !isfinite(y0) || !isfinite(x1) ||
+		    !isfinite(y1))
+			continue;
+		dx = x1 - x0;
+		dy = y1 - y0;
+		len2 = dx * dx + dy * dy;
+		seg_left = fmin(x0, x1) - radius;
+		seg_right = fmax(x0, x1) + radius;
+		if (fabs(dy) > 1e-9)
+			hx = radius * sqrt(len2) / fabs(dy) + 1.0;
+
+		/* Clamped as doubles, far away points overflow an int. */
+		row_min = fmin(fmax(floor(fmin(y0, y1) - radius), my),
+		    my + mh);
+		row_max = fmax(fmin(ceil(fmax(y0, y1) + radius), my + mh), my);
+
+		for (row = row_min; row < row_max; row++) {
+			py = row + 0.5;
+
+			/* Columns of this row within reach of the segment. */
+			left = seg_left;
+			right = seg_right;
+			if (fabs(dy) > 1e-9) {
+				xl = x0 + (py - y0) * dx / dy;
+				left = fmax(left, xl - hx);
+				right = fmin(right, xl + hx);
+			}
+			col_min = fmin(fmax(floor(left), mx), mx + mw);
+			col_max = fmax(fmin(ceil(right), mx + mw), mx);
+
+			for (col = col_min; col < col_max; col++) {
+				px = col + 0.5;
+				t = len2 > 0.0 ?
+				    ((px - x0) * dx + (py - y0) * dy) / len2 :
+				    0.0;
+				/* NaN if len2 overflowed. */
+				if (!(t >= 0.0))
+					t = 0.0;
+				else if (t > 1.0)
+					t = 1.0;
+				qx = px - (x0 + t * dx);
+				qy = py - (y0 + t * dy);
+				d2 = qx * qx + qy * qy;
+				if (!(d2 < radius2))
+					continue;
+				d = sqrt(d2);
+				coverage = d <= radius - 1.0 ? 255 :
+				    (unsigned int)((radius - d) * 255.0 + 0.5);
+				if (coverage > mask[(row - my) * mw + col - mx])
+					mask[(row - my) * mw + col - mx] =
+					    coverage;
+			}
+		}
+	}
+
+	for (row = 0; row < mh; row++) {
+		pixels = (uint32_t *)(raster->data + (my + row) *
+		    raster->stride) + mx;
+		for (col = 0; col < mw; col++) {
+			if (mask[row * mw + col] > 0)
+				pixels[col] = raster_pixel(pixels[col], red,
+				    green, blue, mask[row * mw + col]);
+		}
+	}
+
+	free(mask);
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Point reduction for polylines. Consecutive points falling in the same
+ * output column are replaced by the first, lowest, highest and last of them
+ * (in their original order), which draws the same pixels as the full run.
+ * The output therefore holds at most four points per column of the target,
+ * whatever the number of points pushed.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chartesque.h"
+
+static void	reduce_emit(chq_reduce_t *, double, double);
+
+
+/**
+ * Constructor for a chq_reduce, one column per unit and no rounding.
+ */
+chq_reduce_t *
+chq_reduce_new()
+{
+	chq_reduce_t *reduce = calloc(1, sizeof(chq_reduce_t));
+
+	reduce->resolution = 1.0;
+	reduce->precision = 0.0;
+
+	return reduce;
+}
+
+
+/**
+ * Destructor for chq_reduce.
+ */
+void
+chq_reduce_kill(chq_reduce_t *reduce)
+{
+	free(reduce->x);
+	free(reduce->y);
+	free(reduce);
+}
+
+
+/**
+ * Drop all the points and start over with a column width of resolution.
+ * Emitted coordinates are rounded to 1 / precision units, unless precision
+ * is 0. The output arrays are kept for reuse.
+ */
+void
+chq_reduce_reset(chq_reduce_t *reduce, double resolution, double precision)
+{
+	reduce->resolution = resolution > 0.0 ? resolution : 1.0;
+	reduce->precision = precision;
+	reduce->len = 0;
+	reduce->open = 0;
+}
+
+
+/**
+ * Make dst an exact copy of src, including the column being accumulated,
+ * so more points can be pushed to it without touching src.
+ */
+void
+chq_reduce_copy(chq_reduce_t *dst, chq_reduce_t *src)
+{
+	double *x = dst->x, *y = dst->y;
+	size_t size = dst->size;
+
+	if (size < src->len) {
+		size = src->size;
+		x = realloc(dst->x, sizeof(double) * size);
+		if (x == NULL)
+			return;
+		dst->x = x;
+		y = realloc(dst->y, sizeof(double) * size);
+		if (y == NULL)
+			return;
+	}
+
+	*dst = *src;
+	dst->x = x;
+	dst->y = y;
+	dst->size = size;
+	if (src->len > 0) {
+		memcpy(dst->x, src->x, sizeof(double) * src->len);
+		memcpy(dst->y, src->y, sizeof(double) * src->len);
+	}
+}
+
+
+/**
+ * Append a point to the output, skipping exact repeats of the last one.
+ */
+static void
+reduce_emit(chq_reduce_t *reduce, double x, double y)
+{
+	size_t size;
+	double *nx, *ny;
+
+	if (reduce->precision > 0.0) {
+		x = round(x * reduce->precision) / reduce->precision;
+		y = round(y * reduce->precision) / reduce->precision;
+	}
+
+	if (reduce->len > 0 && reduce->x[reduce->len - 1] == x &&
+	    reduce->y[reduce->len - 1] == y)
+		return;
+
+	if (reduce->len == reduce->size) {
+		size = reduce->size ? reduce->size * 2 : 1024;
+		nx = realloc(reduce->x, sizeof(double) * size);
+		if (nx == NULL)
+			return;
+		reduce->x = nx;
+		ny = realloc(reduce->y, sizeof(double) * size);
+		if (ny == NULL)
+			return;
+		reduce->y = ny;
+		reduce->size = size;
+	}
+
+	reduce->x[reduce->len] = x;
+	reduce->y[reduce->len] = y;
+	reduce->len++;
+}
+
+
+/**
+ * Feed a point, in output coordinates.
+ */
+void
+chq_reduce_push(chq_reduce_t *reduce, double x, double y)
+{
+	double column = floor(x / reduce->resolution);
+
+	if (!reduce->open || column != reduce->column) {
+		chq_reduce_flush(reduce);
+		reduce->open = 1;
+		reduce->column = column;
+		reduce->count = 0;
+		reduce->first_x = reduce->min_x = reduce->max_x = x;
+		reduce->first_y = reduce->min_y = reduce->max_y = y;
+		reduce->min_seq = reduce->max_seq = 0;
+	} else {
+		reduce->count++;
+		if (y < reduce->min_y) {
+			reduce->min_x = x;
+			reduce->min_y = y;
+			reduce->min_seq = reduce->count;
+		}
+		if (y > reduce->max_y) {
+			reduce->max_x = x;
+			reduce->max_y = y;
+			reduce->max_seq = reduce->count;
+		}
+	}
+
+	reduce->last_x = x;
+	reduce->last_y = y;
+}
+
+
+/**
+ * Emit the column being accumulated, call once after the last push.
+ */
+void
+chq_reduce_flush(chq_reduce_t *reduce)
+{
+	if (!reduce->open)
+		return;
+
+	reduce_emit(reduce, reduce->first_x, reduce->first_y);
+	if (reduce->min_seq < reduce->max_seq) {
+		reduce_emit(reduce, reduce->min_x, reduce->min_y);
+		reduce_emit(reduce, reduce->max_x, reduce->max_y);
+	} else {
+		reduce_emit(reduce, reduce->max_x, reduce->max_y);
+		reduce_emit(reduce, reduce->min_x, reduce->min_y);
+	}
+	reduce_emit(reduce, reduce->last_x, reduce->last_y);
+
+	reduce->open = 0;
+}
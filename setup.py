@@ -0,0 +1,28 @@
+# Build the chartesque Python module in place with:
+#
+#     python3 setup.py build_ext --inplace
+
+import subprocess
+
+from setuptools import Extension, setup
+
+
+def pkg_config(*args):
+    return subprocess.check_output(("pkg-config",) + args + ("cairo",),
+                                   text=True).split()
+
+
+sources = ["chartesquemodule.c", "axis.c", "buffer.c", "csv.c", "dataplot.c",
+           "grid.c", "kernel.c", "layout.c", "overlay.c", "pick.c", "pool.c",
+           "raster.c", "reduce.c", "store.c", "strlcpy.c", "timeaxis.c",
+           "vector.c"]
+
+setup(
+    name="chartesque",
+    ext_modules=[Extension(
+        "chartesque",
+        sources=sources,
+        extra_compile_args=pkg_config("--cflags"),
+        extra_link_args=pkg_config("--libs") + ["-lm", "-lpthread"],
+    )],
+)
@@ -0,0 +1,701 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Chunked series files, for archives too large to be loaded whole. The
+ * points are cut in chunks of a fixed number of rows, each stored as its X
+ * column followed by its Y column, and described in a directory at the end
+ * of the file by a zone map: the count, the ranges of X and Y, and the
+ * first, last, lowest and highest points.
+ *
+ * The file is mapped, and a render only touches the chunks whose X range
+ * meets the limits of the X axis. A chunk that falls in a single column of
+ * the output is not read at all: its zone map holds the four points the
+ * reducer would keep out of it.
+ *
+ * X columns made of integers (timestamps) are stored as the differences
+ * between consecutive values, zigzag encoded and packed on as few bits as
+ * the largest of them needs. Y columns are stored as is and used in place.
+ * Numbers are in the byte order of the host that wrote the file, which is
+ * checked when it is opened.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chartesque.h"
+
+#define STORE_MAGIC		"CHQS"
+#define STORE_VERSION		1
+#define STORE_BYTE_ORDER	0x01020304
+
+/* Largest magnitude up to which every integer is a double. */
+#define STORE_MAX_EXACT		9007199254740992.0
+
+enum store_encoding {
+	STORE_RAW = 0,
+	STORE_DELTA = 1
+};
+
+struct store_header {
+	char		 magic[4];
+	uint32_t	 version;
+	uint32_t	 byte_order;
+	uint32_t	 chunk_rows;
+	uint64_t	 rows;
+	uint64_t	 chunks_count;
+	uint64_t	 directory_offset;
+};
+
+struct chq_store_chunk {
+	uint64_t	 offset;
+	uint32_t	 count;
+	uint32_t	 x_encoding;
+	uint32_t	 x_bits;
+	uint32_t	 has_nan;
+	int64_t		 x_base;
+	uint64_t	 x_size;
+	/* zone map */
+	double		 x_min, x_max;
+	double		 y_min, y_max;
+	double		 first_x, first_y;
+	double		 last_x, last_y;
+	double		 min_x, max_x;
+	uint32_t	 min_seq, max_seq;
+};
+
+static void	store_chunk_stats(struct chq_store_chunk *, const double *,
+			const double *, size_t);
+static int	store_can_pack(const double *, size_t, int64_t *, uint32_t *);
+static int	store_write_packed(FILE *, const double *, size_t, uint32_t,
+			uint64_t *);
+static int	store_writer_flush(chq_store_writer_t *);
+static const double	*store_chunk_x(chq_store_t *,
+			const struct chq_store_chunk *);
+static int	store_chunk_meets(const struct chq_store_chunk *, double,
+			double);
+static double	store_column(chq_dataplot_t *, chq_reduce_t *, double);
+
+
+/**
+ * Fill the zone map of a chunk, NaN are left out of the ranges.
+ */
+static void
+store_chunk_stats(struct chq_store_chunk *chunk, const double *x,
+		const double *y, size_t count)
+{
+	size_t i;
+
+	chunk->count = count;
+	chunk->has_nan = 0;
+	chunk->x_min = chunk->y_min = INFINITY;
+	chunk->x_max = chunk->y_max = -INFINITY;
+	chunk->first_x = x[0];
+	chunk->first_y = y[0];
+	chunk->last_x = x[count - 1];
+	chunk->last_y = y[count - 1];
+	chunk->min_x = chunk->max_x = x[0];
+	chunk->min_seq = chunk->max_seq = 0;
+
+	for (i = 0; i < count; i++) {
+		if (isnan(x[i]) || isnan(y[i])) {
+			chunk->has_nan = 1;
+			continue;
+		}
+		if (x[i] < chunk->x_min)
+			chunk->x_min = x[i];
+		if (x[i] > chunk->x_max)
+			chunk->x_max = x[i];
+		if (y[i] < chunk->y_min) {
+			chunk->y_min = y[i];
+			chunk->min_x = x[i];
+			chunk->min_seq = i;
+		}
+		if (y[i] > chunk->y_max) {
+			chunk->y_max = y[i];
+			chunk->max_x = x[i];
+			chunk->max_seq = i;
+		}
+	}
+}
+
+
+/**
+ * Tell if the X values are integers that can be delta encoded, and on how
+ * many bits the deltas fit.
+ */
+static int
+store_can_pack(const double *x, size_t count, int64_t *base, uint32_t *bits)
+{
+	size_t i;
+	int64_t delta;
+	uint64_t zigzag, all = 0;
+
+	for (i = 0; i < count; i++)
+		if (!(fabs(x[i]) <= STORE_MAX_EXACT) || x[i] != floor(x[i]))
+			return 0;
+
+	for (i = 1; i < count; i++) {
+		delta = (int64_t)x[i] - (int64_t)x[i - 1];
+		zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		all |= zigzag;
+	}
+
+	*base = x[0];
+	for (*bits = 0; *bits < 64 && (all >> *bits) != 0; (*bits)++)
+		;
+
+	return 1;
+}
+
+
+/**
+ * Write the packed deltas of an X column, padded to whole 64-bit words.
+ */
+static int
+store_write_packed(FILE *fp, const double *x, size_t count, uint32_t bits,
+		uint64_t *size)
+{
+	size_t i, words = ((count - 1) * bits + 63) / 64;
+	uint64_t *packed, zigzag;
+	int64_t delta;
+	size_t bit;
+	int error;
+
+	*size = words * sizeof(uint64_t);
+	if (words == 0)
+		return 0;
+
+	packed = calloc(words, sizeof(uint64_t));
+	if (packed == NULL)
+		return -1;
+
+	for (i = 1; i < count; i++) {
+		delta = (int64_t)x[i] - (int64_t)x[i - 1];
+		zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		bit = (i - 1) * bits;
+		packed[bit / 64] |= zigzag << (bit % 64);
+		if (bit % 64 + bits > 64)
+			packed[bit / 64 + 1] |= zigzag >> (64 - bit % 64);
+	}
+
+	error = fwrite(packed, sizeof(uint64_t), words, fp) != words;
+	free(packed);
+
+	return error ? -1 : 0;
+}
+
+
+/**
+ * Start a new series file at path, in chunks of chunk_rows (0 for the
+ * default). The points are given by chq_store_writer_append(), as many
+ * times as needed, and the file is completed by chq_store_writer_close():
+ * only one chunk is held in memory. Returns NULL on failure with errno set.
+ */
+chq_store_writer_t *
+chq_store_writer_new(const char *path, unsigned int chunk_rows)
+{
+	struct store_header header;
+	chq_store_writer_t *writer;
+	int saved_errno;
+
+	writer = calloc(1, sizeof(chq_store_writer_t));
+	if (writer == NULL)
+		return NULL;
+
+	writer->chunk_rows = chunk_rows ? chunk_rows : CHQ_STORE_CHUNK_ROWS;
+	writer->path = strdup(path);
+	writer->x = malloc(sizeof(double) * writer->chunk_rows);
+	writer->y = malloc(sizeof(double) * writer->chunk_rows);
+	if (writer->path == NULL || writer->x == NULL || writer->y == NULL)
+		goto fail;
+
+	writer->fp = fopen(path, "wb");
+	if (writer->fp == NULL)
+		goto fail;
+
+	/* Rewritten with the counts when the file is closed. */
+	memset(&header, 0, sizeof(header));
+	if (fwrite(&header, sizeof(header), 1, writer->fp) != 1) {
+		saved_errno = errno;
+		fclose(writer->fp);
+		unlink(path);
+		errno = saved_errno;
+		goto fail;
+	}
+	writer->offset = sizeof(header);
+
+	return writer;
+
+fail:
+	free(writer->path);
+	free(writer->x);
+	free(writer->y);
+	free(writer);
+	return NULL;
+}
+
+
+/**
+ * Write the pending rows as a chunk and add it to the directory. Returns -1
+ * on failure.
+ */
+static int
+store_writer_flush(chq_store_writer_t *writer)
+{
+	struct chq_store_chunk *chunk, *grown;
+	size_t count = writer->pending, size;
+
+	if (count == 0)
+		return 0;
+
+	if (writer->chunks_count == writer->chunks_size) {
+		size = writer->chunks_size ? writer->chunks_size * 2 : 64;
+		grown = realloc(writer->chunks,
+				size * sizeof(struct chq_store_chunk));
+		if (grown == NULL)
+			return -1;
+		writer->chunks = grown;
+		writer->chunks_size = size;
+	}
+	chunk = &writer->chunks[writer->chunks_count];
+	memset(chunk, 0, sizeof(struct chq_store_chunk));
+
+	store_chunk_stats(chunk, writer->x, writer->y, count);
+	chunk->offset = writer->offset;
+
+	if (store_can_pack(writer->x, count, &chunk->x_base,
+	    &chunk->x_bits)) {
+		chunk->x_encoding = STORE_DELTA;
+		if (store_write_packed(writer->fp, writer->x, count,
+		    chunk->x_bits, &chunk->x_size) == -1)
+			return -1;
+	} else {
+		chunk->x_encoding = STORE_RAW;
+		chunk->x_size = count * sizeof(double);
+		if (fwrite(writer->x, sizeof(double), count, writer->fp) !=
+		    count)
+			return -1;
+	}
+
+	if (fwrite(writer->y, sizeof(double), count, writer->fp) != count)
+		return -1;
+
+	writer->offset += chunk->x_size + count * sizeof(double);
+	writer->rows += count;
+	writer->chunks_count++;
+	writer->pending = 0;
+
+	return 0;
+}
+
+
+/**
+ * Append len points to a series file being written. Returns 0 on success,
+ * -1 on failure, after which the file can only be closed (and is removed).
+ */
+int
+chq_store_writer_append(chq_store_writer_t *writer, const double *data_x,
+		const double *data_y, size_t len)
+{
+	size_t count;
+
+	while (len > 0 && !writer->error) {
+		count = writer->chunk_rows - writer->pending;
+		if (count > len)
+			count = len;
+		memcpy(writer->x + writer->pending, data_x,
+		    sizeof(double) * count);
+		memcpy(writer->y + writer->pending, data_y,
+		    sizeof(double) * count);
+		writer->pending += count;
+		data_x += count;
+		data_y += count;
+		len -= count;
+
+		if (writer->pending == writer->chunk_rows &&
+		    store_writer_flush(writer) == -1)
+			writer->error = 1;
+	}
+
+	return writer->error ? -1 : 0;
+}
+
+
+/**
+ * Write the last chunk, the directory and the header, and free the writer.
+ * Returns 0 on success, -1 on failure (now or during an append) with errno
+ * set, in which case the file is removed.
+ */
+int
+chq_store_writer_close(chq_store_writer_t *writer)
+{
+	struct store_header header;
+	int error = writer->error, saved_errno;
+
+	if (!error && store_writer_flush(writer) == -1)
+		error = 1;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STORE_MAGIC, 4);
+	header.version = STORE_VERSION;
+	header.byte_order = STORE_BYTE_ORDER;
+	header.chunk_rows = writer->chunk_rows;
+	header.rows = writer->rows;
+	header.chunks_count = writer->chunks_count;
+	header.directory_offset = writer->offset;
+
+	if (!error && writer->chunks_count > 0 && fwrite(writer->chunks,
+	    sizeof(struct chq_store_chunk), writer->chunks_count,
+	    writer->fp) != writer->chunks_count)
+		error = 1;
+	if (!error && (fseek(writer->fp, 0, SEEK_SET) == -1 ||
+	    fwrite(&header, sizeof(header), 1, writer->fp) != 1))
+		error = 1;
+
+	saved_errno = errno;
+	if (fclose(writer->fp) != 0 && !error) {
+		error = 1;
+		saved_errno = errno;
+	}
+	if (error) {
+		unlink(writer->path);
+		errno = saved_errno;
+	}
+
+	free(writer->path);
+	free(writer->chunks);
+	free(writer->x);
+	free(writer->y);
+	free(writer);
+
+	return error ? -1 : 0;
+}
+
+
+/**
+ * Write len points to a new series file at path, in chunks of chunk_rows.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int
+chq_store_write(const char *path, const double *data_x, const double *data_y,
+		size_t len, unsigned int chunk_rows)
+{
+	chq_store_writer_t *writer;
+
+	writer = chq_store_writer_new(path, chunk_rows);
+	if (writer == NULL)
+		return -1;
+
+	chq_store_writer_append(writer, data_x, data_y, len);
+
+	return chq_store_writer_close(writer);
+}
+
+
+/**
+ * Open a series file, NULL if it cannot be read or is not one.
+ */
+chq_store_t *
+chq_store_open(const char *path)
+{
+	const struct store_header *header;
+	chq_store_t *store;
+	struct stat st;
+
+	store = calloc(1, sizeof(chq_store_t));
+	if (store == NULL)
+		return NULL;
+
+	store->fd = open(path, O_RDONLY);
+	if (store->fd == -1 || fstat(store->fd, &st) == -1 ||
+	    (size_t)st.st_size < sizeof(struct store_header))
+		goto fail;
+
+	store->map_len = st.st_size;
+	store->map = mmap(NULL, store->map_len, PROT_READ, MAP_PRIVATE,
+			store->fd, 0);
+	if (store->map == MAP_FAILED) {
+		store->map = NULL;
+		goto fail;
+	}
+	/* Only the chunks in view are read, no point reading ahead. */
+	madvise(store->map, store->map_len, MADV_RANDOM);
+
+	header = (const struct store_header *)store->map;
+	if (memcmp(header->magic, STORE_MAGIC, 4) != 0 ||
+	    header->version != STORE_VERSION ||
+	    header->byte_order != STORE_BYTE_ORDER ||
+	    header->directory_offset > store->map_len ||
+	    header->chunks_count > (store->map_len -
+	    header->directory_offset) / sizeof(struct chq_store_chunk))
+		goto fail;
+
+	store->rows = header->rows;
+	store->chunk_rows = header->chunk_rows;
+	store->chunks_count = header->chunks_count;
+	store->chunks = (const struct chq_store_chunk *)(store->map +
+			header->directory_offset);
+
+	store->scratch = malloc(sizeof(double) * (store->chunk_rows ?
+			store->chunk_rows : 1));
+	if (store->scratch == NULL)
+		goto fail;
+	store->stats = 1;
+
+	return store;
+
+fail:
+	chq_store_kill(store);
+	return NULL;
+}
+
+
+/**
+ * Destructor for a chq_store.
+ */
+void
+chq_store_kill(chq_store_t *store)
+{
+	if (store->map != NULL)
+		munmap(store->map, store->map_len);
+	if (store->fd != -1)
+		close(store->fd);
+	free(store->scratch);
+	free(store);
+}
+
+
+/**
+ * Get the range of the values of the whole file from the zone maps.
+ */
+void
+chq_store_get_limits(chq_store_t *store, double *x_min, double *x_max,
+		double *y_min, double *y_max)
+{
+	const struct chq_store_chunk *chunk;
+	uint64_t i;
+
+	*x_min = *y_min = INFINITY;
+	*x_max = *y_max = -INFINITY;
+
+	for (i = 0; i < store->chunks_count; i++) {
+		chunk = &store->chunks[i];
+		if (chunk->x_min < *x_min)
+			*x_min = chunk->x_min;
+		if (chunk->x_max > *x_max)
+			*x_max = chunk->x_max;
+		if (chunk->y_min < *y_min)
+			*y_min = chunk->y_min;
+		if (chunk->y_max > *y_max)
+			*y_max = chunk->y_max;
+	}
+}
+
+
+/**
+ * Get the X values of a chunk, decoded in the scratch array if they were
+ * packed, in place otherwise. NULL if the chunk is past the end of the file.
+ */
+static const double *
+store_chunk_x(chq_store_t *store, const struct chq_store_chunk *chunk)
+{
+	const uint64_t *packed;
+	uint64_t zigzag, mask, bits = chunk->x_bits;
+	int64_t value = chunk->x_base;
+	size_t i, bit;
+
+	if (chunk->count == 0 || chunk->count > store->chunk_rows ||
+	    chunk->offset + chunk->x_size + chunk->count * sizeof(double) >
+	    store->map_len)
+		return NULL;
+
+	if (chunk->x_encoding == STORE_RAW)
+		return chunk->x_size == chunk->count * sizeof(double) ?
+		    (const double *)(store->map + chunk->offset) : NULL;
+
+	if (bits > 64 || chunk->x_size <
+	    ((chunk->count - 1) * bits + 63) / 64 * sizeof(uint64_t))
+		return NULL;
+
+	packed = (const uint64_t *)(store->map + chunk->offset);
+	mask = bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+
+	store->scratch[0] = value;
+	for (i = 1; i < chunk->count; i++) {
+		zigzag = 0;
+		if (bits > 0) {
+			bit = (i - 1) * bits;
+			zigzag = packed[bit / 64] >> (bit % 64);
+			if (bit % 64 + bits > 64)
+				zigzag |= packed[bit / 64 + 1] <<
+				    (64 - bit % 64);
+			zigzag &= mask;
+		}
+		value += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+		store->scratch[i] = value;
+	}
+
+	return store->scratch;
+}
+
+
+/**
+ * Get the points of a chunk, decoded. The X values may be those of the
+ * store's scratch space, only valid until the next read. Returns the number
+ * of points, 0 if the chunk is out of range or damaged.
+ */
+size_t
+chq_store_read(chq_store_t *store, uint64_t index, const double **x,
+		const double **y)
+{
+	const struct chq_store_chunk *chunk;
+
+	if (index >= store->chunks_count)
+		return 0;
+	chunk = &store->chunks[index];
+
+	*x = store_chunk_x(store, chunk);
+	if (*x == NULL)
+		return 0;
+	*y = (const double *)(store->map + chunk->offset + chunk->x_size);
+
+	return chunk->count;
+}
+
+
+/**
+ * Tell if a chunk has points between min and max.
+ */
+static int
+store_chunk_meets(const struct chq_store_chunk *chunk, double min, double max)
+{
+	return chunk->x_max >= min && chunk->x_min <= max;
+}
+
+
+/**
+ * Output column of the reducer an X value falls in, as chq_reduce_push()
+ * computes it.
+ */
+static double
+store_column(chq_dataplot_t *chart, chq_reduce_t *reduce, double x)
+{
+	double left = chart->margin_left +
+		chq_axis_vertical_get_width(chart->y_axis);
+
+	return floor((left + chq_axis_convert_to_scale(chart->x_axis, x)) /
+			reduce->resolution);
+}
+
+
+/**
+ * Feed the points of the chart's store that are within the limits of the
+ * X axis to reduce, along with the nearest points on both sides so the line
+ * leaves the plot the way it would with all the data. Returns -1 if the
+ * cancel callback interrupted it, 0 otherwise.
+ */
+int
+chq_dataplot_reduce_store(chq_dataplot_t *chart, chq_reduce_t *reduce)
+{
+	chq_store_t *store = chart->store;
+	const struct chq_store_chunk *chunk, *skipped = NULL;
+	double min = chart->x_axis->limit_min, max = chart->x_axis->limit_max;
+	const double *x, *y;
+	int shown = 0;
+	uint64_t i;
+
+	for (i = 0; i < store->chunks_count; i++) {
+		chunk = &store->chunks[i];
+
+		if (!store_chunk_meets(chunk, min, max)) {
+			/* Leaving the plot, draw up to the next point. */
+			if (shown)
+				chq_dataplot_reduce_array(chart, reduce,
+				    &chunk->first_x, &chunk->first_y, 0, 1, 1);
+			shown = 0;
+			skipped = chunk;
+			continue;
+		}
+
+		/* Entering it, draw from the previous point. */
+		if (!shown && skipped != NULL)
+			chq_dataplot_reduce_array(chart, reduce,
+			    &skipped->last_x, &skipped->last_y, 0, 1, 1);
+		shown = 1;
+
+		/*
+		 * Within one column, the reducer would only keep the first,
+		 * lowest, highest and last points: the zone map has them. The
+		 * overlays need every point.
+		 */
+		if (store->stats && !chunk->has_nan &&
+		    chart->overlays == NULL &&
+		    store_column(chart, reduce, chunk->x_min) ==
+		    store_column(chart, reduce, chunk->x_max)) {
+			chq_dataplot_reduce_array(chart, reduce,
+			    &chunk->first_x, &chunk->first_y, 0, 1, 1);
+			if (chunk->min_seq < chunk->max_seq) {
+				chq_dataplot_reduce_array(chart, reduce,
+				    &chunk->min_x, &chunk->y_min, 0, 1, 1);
+				chq_dataplot_reduce_array(chart, reduce,
+				    &chunk->max_x, &chunk->y_max, 0, 1, 1);
+			} else {
+				chq_dataplot_reduce_array(chart, reduce,
+				    &chunk->max_x, &chunk->y_max, 0, 1, 1);
+				chq_dataplot_reduce_array(chart, reduce,
+				    &chunk->min_x, &chunk->y_min, 0, 1, 1);
+			}
+			chq_dataplot_reduce_array(chart, reduce,
+			    &chunk->last_x, &chunk->last_y, 0, 1, 1);
+			continue;
+		}
+
+		x = store_chunk_x(store, chunk);
+		if (x == NULL)
+			continue;
+		y = (const double *)(store->map + chunk->offset +
+				chunk->x_size);
+		if (chq_dataplot_reduce_array(chart, reduce, x, y, 0,
+		    chunk->count, 1) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Plot the points of a series file. The store is only borrowed, the caller
+ * must keep it open as long as the chart may be rendered, and renders of
+ * charts sharing a store must not run at the same time.
+ */
+void
+chq_dataplot_set_store(chq_dataplot_t *chart, chq_store_t *store)
+{
+	chq_dataplot_set_data(chart, NULL, NULL, 0);
+	chart->store = store;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Benchmark of the data pass kernels, run by "make bench". The kernels of
+ * kernel.c are timed on BENCH_POINTS points against the generic loop they
+ * replaced (chq_axis_convert_to_scale() and a NaN test per point, on
+ * doubles), best of BENCH_RUNS, for columns of each type. The kernels that
+ * do not check for NaN only run on data without any.
+ *
+ * The drawing of the reduced points is then timed through cairo and
+ * through the software rasterizer (fast_raster) on an image surface.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "chartesque.h"
+
+#define BENCH_POINTS	10000000
+#define BENCH_RUNS	5
+#define BENCH_WIDTH	800
+#define BENCH_HEIGHT	600
+
+static double	now(void);
+static void	generic(chq_dataplot_t *, chq_reduce_t *, chq_overlay_t *);
+static double	time_generic(chq_dataplot_t *, chq_reduce_t *,
+			chq_overlay_t *);
+static double	time_kernel(chq_dataplot_t *, chq_reduce_t *,
+			chq_overlay_t *, enum column_type, const void *,
+			const void *, int, const char **);
+static void	bench(chq_dataplot_t *, chq_reduce_t *, chq_overlay_t *,
+			enum column_type, const void *, const void *, int,
+			const char *);
+static double	time_draw(chq_dataplot_t *, int);
+static void	bench_raster(chq_dataplot_t *);
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * The data loop as it was before the kernels.
+ */
+static void
+generic(chq_dataplot_t *chart, chq_reduce_t *reduce, chq_overlay_t *overlays)
+{
+	double left = chart->margin_left +
+		chq_axis_vertical_get_width(chart->y_axis);
+	double top = chart->margin_top;
+	const double *data_x = chart->data_x, *data_y = chart->data_y;
+	chq_overlay_t *overlay;
+	double x, y;
+	size_t i;
+
+	for (i = 0; i < chart->data_len; i++) {
+		x = chq_axis_convert_to_scale(chart->x_axis, data_x[i]);
+		y = chq_axis_convert_to_scale(chart->y_axis, data_y[i]);
+		if (isnan(x) || isnan(y))
+			continue;
+		chq_reduce_push(reduce, left + x, top + y);
+		for (overlay = overlays; overlay != NULL;
+		    overlay = overlay->next)
+			chq_overlay_push(overlay, left + x, top + y);
+	}
+}
+
+
+static double
+time_generic(chq_dataplot_t *chart, chq_reduce_t *reduce,
+		chq_overlay_t *overlays)
+{
+	double best = INFINITY, start;
+	int i;
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		chq_reduce_reset(reduce, 1.0, 0.0);
+		if (overlays != NULL)
+			chq_overlay_begin(overlays, 1.0, 0.0,
+			    chart->margin_top, chart->y_axis->size);
+		start = now();
+		generic(chart, reduce, overlays);
+		chq_reduce_flush(reduce);
+		best = fmin(best, now() - start);
+	}
+
+	return best;
+}
+
+
+/**
+ * Time the kernel for columns of type, both X and Y.
+ */
+static double
+time_kernel(chq_dataplot_t *chart, chq_reduce_t *reduce,
+		chq_overlay_t *overlays, enum column_type type, const void *x,
+		const void *y, int finite, const char **name)
+{
+	chq_kernel_t kernel;
+	double best = INFINITY, start;
+	int i;
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		chq_reduce_reset(reduce, 1.0, 0.0);
+		if (overlays != NULL)
+			chq_overlay_begin(overlays, 1.0, 0.0,
+			    chart->margin_top, chart->y_axis->size);
+		start = now();
+		chq_kernel_setup(&kernel, chart, overlays, type, type,
+		    finite);
+		kernel.run(&kernel, reduce, x, y, 0, chart->data_len, 1);
+		chq_reduce_flush(reduce);
+		best = fmin(best, now() - start);
+	}
+	*name = kernel.name;
+
+	return best;
+}
+
+
+static void
+bench(chq_dataplot_t *chart, chq_reduce_t *reduce, chq_overlay_t *overlays,
+		enum column_type type, const void *x, const void *y,
+		int finite, const char *data)
+{
+	const char *name;
+	double reference, specialized;
+
+	reference = time_generic(chart, reduce, overlays);
+	specialized = time_kernel(chart, reduce, overlays, type, x, y,
+	    finite, &name);
+
+	printf("%-8s %-30s generic %8.2fms  kernel %8.2fms  x%.2f\n", data,
+	    name, reference * 1e3, specialized * 1e3,
+	    reference / specialized);
+}
+
+
+/**
+ * Time drawing the chart's reduced points, best of BENCH_RUNS.
+ */
+static double
+time_draw(chq_dataplot_t *chart, int fast_raster)
+{
+	double best = INFINITY, start;
+	int i;
+
+	chq_dataplot_set_fast_raster(chart, fast_raster);
+	for (i = 0; i < BENCH_RUNS; i++) {
+		cairo_save(chart->cr);
+		cairo_set_source_rgb(chart->cr, 1, 1, 1);
+		cairo_paint(chart->cr);
+		cairo_restore(chart->cr);
+		cairo_surface_flush(cairo_get_target(chart->cr));
+
+		start = now();
+		chq_dataplot_draw_reduced(chart, chart->reduce);
+		cairo_surface_flush(cairo_get_target(chart->cr));
+		best = fmin(best, now() - start);
+	}
+
+	return best;
+}
+
+
+static void
+bench_raster(chq_dataplot_t *chart)
+{
+	cairo_surface_t *surface;
+	double with_cairo, with_raster;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, BENCH_WIDTH,
+			BENCH_HEIGHT);
+	chart->cr = cairo_create(surface);
+	chq_dataplot_set_width(chart, BENCH_WIDTH);
+	chq_dataplot_set_height(chart, BENCH_HEIGHT);
+	chq_dataplot_prepare_axes(chart);
+	chq_dataplot_reduce_begin(chart, chart->reduce);
+	chq_dataplot_reduce_range(chart, chart->reduce, 0, chart->data_len, 1);
+	chq_reduce_flush(chart->reduce);
+
+	with_cairo = time_draw(chart, 0);
+	with_raster = time_draw(chart, 1);
+	printf("%-8s %-30s cairo   %8.2fms  raster %8.2fms  x%.2f\n", "draw",
+	    "reduced", with_cairo * 1e3, with_raster * 1e3,
+	    with_cairo / with_raster);
+
+	cairo_destroy(chart->cr);
+	chart->cr = NULL;
+	cairo_surface_destroy(surface);
+}
+
+
+int
+main(void)
+{
+	chq_dataplot_t *chart;
+	chq_reduce_t *reduce;
+	chq_overlay_t *overlay;
+	double *x, *y;
+	float *fx, *fy;
+	int64_t *ix, *iy;
+	size_t i;
+
+	x = malloc(sizeof(double) * BENCH_POINTS);
+	y = malloc(sizeof(double) * BENCH_POINTS);
+	fx = malloc(sizeof(float) * BENCH_POINTS);
+	fy = malloc(sizeof(float) * BENCH_POINTS);
+	ix = malloc(sizeof(int64_t) * BENCH_POINTS);
+	iy = malloc(sizeof(int64_t) * BENCH_POINTS);
+	if (x == NULL || y == NULL || fx == NULL || fy == NULL ||
+	    ix == NULL || iy == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < BENCH_POINTS; i++) {
+		x[i] = i;
+		y[i] = sin(i / 1e4) + sin(i / 7.0) / 10.0;
+		fx[i] = x[i];
+		fy[i] = y[i];
+		/* Whole values only, the generic loop reads the same. */
+		ix[i] = i;
+		iy[i] = y[i] > 0.0;
+	}
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_data(chart, x, y, BENCH_POINTS);
+	chq_axis_set_limit(chart->x_axis, 0, BENCH_POINTS);
+	chq_axis_set_limit(chart->y_axis, -1.2, 1.2);
+	chq_axis_set_size(chart->x_axis, BENCH_WIDTH);
+	chq_axis_set_size(chart->y_axis, BENCH_HEIGHT);
+	reduce = chq_reduce_new();
+	overlay = chq_overlay_new(CHQ_OVERLAY_ENVELOPE, 1000);
+
+	bench(chart, reduce, NULL, CHQ_COLUMN_DOUBLE, x, y, 1, "finite");
+	bench(chart, reduce, NULL, CHQ_COLUMN_DOUBLE, x, y, 0, "finite");
+	bench(chart, reduce, overlay, CHQ_COLUMN_DOUBLE, x, y, 1, "finite");
+	bench(chart, reduce, overlay, CHQ_COLUMN_DOUBLE, x, y, 0, "finite");
+	bench(chart, reduce, NULL, CHQ_COLUMN_FLOAT, fx, fy, 1, "finite");
+	bench(chart, reduce, NULL, CHQ_COLUMN_FLOAT, fx, fy, 0, "finite");
+
+	bench_raster(chart);
+
+	for (i = 0; i < BENCH_POINTS; i++)
+		y[i] = iy[i];
+	bench(chart, reduce, NULL, CHQ_COLUMN_INT64, ix, iy, 1, "int");
+	bench(chart, reduce, NULL, CHQ_COLUMN_INT64, ix, iy, 0, "int");
+
+	for (i = 0; i < BENCH_POINTS; i += 1000)
+		y[i] = fy[i] = NAN;
+	bench(chart, reduce, NULL, CHQ_COLUMN_DOUBLE, x, y, 0, "nan");
+	bench(chart, reduce, overlay, CHQ_COLUMN_DOUBLE, x, y, 0, "nan");
+	bench(chart, reduce, NULL, CHQ_COLUMN_FLOAT, fx, fy, 0, "nan");
+
+	chq_overlay_kill(overlay);
+	chq_reduce_kill(reduce);
+	chq_dataplot_kill(chart);
+	free(x);
+	free(y);
+	free(fx);
+	free(fy);
+	free(ix);
+	free(iy);
+
+	return 0;
+}
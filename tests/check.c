@@ -0,0 +1,2278 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Regression suite run by "make check". Every case of the corpus below is
+ * rendered and:
+ *
+ *  - checked for sanity: cairo did not fail, the axes and the reduced
+ *    points are finite;
+ *  - reduced again with fixed label sizes, and its points (those of the
+ *    overlays included) compared to golden/<name>.points within
+ *    CHECK_POINTS_TOLERANCE pixels. They depend on no font nor rasterizer;
+ *  - compared to its reference image in golden/, a pixel differs if one of
+ *    its channels is off by more than CHECK_TOLERANCE, and a case fails if
+ *    more than CHECK_MAX_DIFF of its pixels differ (fonts are not rendered
+ *    the same everywhere);
+ *  - timed, phase by phase, against timing.baseline: a phase fails if its
+ *    best time over CHECK_RUNS renders is more than CHECK_SLOWER percent
+ *    (or $CHQ_CHECK_SLOWER) above its baseline, and more than CHECK_NOISE
+ *    seconds, below which timings are not reliable.
+ *
+ * The software rasterizer is also compared to cairo on the same chart,
+ * within CHECK_RASTER_TOLERANCE and CHECK_RASTER_MAX_DIFF since they do not
+ * antialias the same way. And a few cases are given as chq_buffers of other
+ * column types, which must look like the double arrays they were made from;
+ * private copies must only be flagged finite when they are. Charts rendered
+ * against a shared layout must look like their own renders. A pooled surface
+ * comes back cleared unless the caller paints the full frame. Every family
+ * of kernels (column types, NaN checks, overlays) is also run on its own
+ * data, and its points compared to their reference. Series files are
+ * written, read back, and rendered with and without their zone maps. Time
+ * axes must put their calendar ticks on round dates, or leave the limits too
+ * close for them to plain ticks. Grids are drawn by threads and through a
+ * transformation, which must agree. Small CSV files check the parser on the
+ * quirks of the format. A cancelled progressive render must resume to the
+ * points of a plain one. Picking must find the nearest point, whether X is
+ * sorted or not. SVG and PDF exports must not grow with the data.
+ *
+ * All the references are made with "make bless" (check -b). The points
+ * are committed with the suite and a missing one is a failure. The images
+ * and timings depend on the machine (fonts, CPU) and are blessed where the
+ * suite runs: without them, the comparisons are skipped and counted. The
+ * images of failed cases are written to out/.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chartesque.h"
+
+#define CHECK_TOLERANCE		16
+#define CHECK_MAX_DIFF		0.002
+#define CHECK_RUNS		5
+#define CHECK_SLOWER		25.0
+#define CHECK_NOISE		0.0005
+#define CHECK_BASELINE		"timing.baseline"
+#define CHECK_RASTER_TOLERANCE	64
+#define CHECK_RASTER_MAX_DIFF	0.01
+#define CHECK_POINTS_TOLERANCE	0.01
+#define CHECK_LABEL_WIDTH	40.0
+#define CHECK_LABEL_HEIGHT	10.0
+#define CHECK_STORE		"check.chq"
+#define CHECK_CSV		"check.csv"
+#define CHECK_PICK_RADIUS	8.0
+#define CHECK_VECTOR_GROWTH	1.5
+
+#ifdef CAIRO_HAS_SVG_SURFACE
+#define CHECK_HAS_SVG		1
+#else
+#define CHECK_HAS_SVG		0
+#endif
+#ifdef CAIRO_HAS_PDF_SURFACE
+#define CHECK_HAS_PDF		1
+#else
+#define CHECK_HAS_PDF		0
+#endif
+
+enum check_phase {
+	PHASE_AXES,
+	PHASE_DATA,
+	PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = { "axes", "data" };
+
+struct check_case {
+	const char	*name;
+	unsigned int	 width;
+	unsigned int	 height;
+	void		(*setup)(chq_dataplot_t *, double **, double **);
+};
+
+struct baseline {
+	char		 name[64];
+	char		 phase[16];
+	double		 seconds;
+};
+
+static void	setup_sine(chq_dataplot_t *, double **, double **);
+static void	setup_fast_raster(chq_dataplot_t *, double **, double **);
+static void	setup_ticks_none(chq_dataplot_t *, double **, double **);
+static void	setup_ticks_one(chq_dataplot_t *, double **, double **);
+static void	setup_zero_spread(chq_dataplot_t *, double **, double **);
+static void	setup_nan(chq_dataplot_t *, double **, double **);
+static void	setup_empty(chq_dataplot_t *, double **, double **);
+static void	setup_overlays(chq_dataplot_t *, double **, double **);
+static void	setup_huge(chq_dataplot_t *, double **, double **);
+static void	make_data(chq_dataplot_t *, double **, double **, size_t,
+			double (*)(size_t, size_t));
+static double	wave(size_t, size_t);
+static double	now(void);
+static int	check_sanity(chq_dataplot_t *, cairo_t *);
+static int	check_axis(chq_axis_t *);
+static size_t	count_differ(cairo_surface_t *, cairo_surface_t *, int,
+			int *);
+static int	check_image(const char *, cairo_surface_t *);
+static void	fixed_axes(chq_dataplot_t *);
+static int	collect_reduce(chq_reduce_t *, double **, size_t *,
+			size_t *);
+static int	collect_points(chq_dataplot_t *, double **, size_t *);
+static int	check_points(const char *, chq_dataplot_t *);
+static cairo_surface_t *render_chart(chq_dataplot_t *, unsigned int,
+			unsigned int);
+static cairo_surface_t *render_case(const struct check_case *, int);
+static const struct check_case *find_case(const char *);
+static int	check_raster(void);
+static chq_buffer_t *make_column(const double *, size_t, enum column_type);
+static int	check_columns(void);
+static int	check_buffers(void);
+static int	check_layout(void);
+static int	check_pool(void);
+static int	check_kernels(void);
+static double	store_x_delta(size_t);
+static double	store_x_fraction(size_t);
+static double	store_x_nan(size_t);
+static int	same_value(double, double);
+static int	check_store_file(const char *, size_t, unsigned int,
+			double (*)(size_t));
+static int	check_store_stats(const char *, double, double);
+static int	check_store(void);
+static int	time_tick_month(const struct tm *, const char *, unsigned int);
+static int	time_tick_monday(const struct tm *, const char *, unsigned int);
+static int	time_tick_second(const struct tm *, const char *,
+			unsigned int);
+static int	check_time_axis(double, double, double,
+			int (*)(const struct tm *, const char *, unsigned int));
+static int	check_time(void);
+static int	check_grid_render(int, int);
+static int	check_grid(void);
+static int	check_csv_file(const char *, const char *, const char *,
+			const char *, size_t, const char **);
+static int	check_csv(void);
+static int	cancel_after(void *);
+static int	check_progressive(void);
+static double	pick_x_sorted(size_t);
+static double	pick_x_nan(size_t);
+static double	pick_x_scatter(size_t);
+static int	check_pick_chart(double (*)(size_t));
+static int	check_pick(void);
+static int	check_vector_file(int (*)(chq_dataplot_t *, const char *),
+			const char *, const char *, size_t, long *);
+static int	check_vector(void);
+static void	write_failure(const char *, cairo_surface_t *);
+static int	load_baselines(struct baseline **);
+static double	find_baseline(struct baseline *, int, const char *,
+			const char *);
+static int	run_case(const struct check_case *, struct baseline *, int,
+			FILE *);
+
+static const struct check_case corpus[] = {
+	{ "sine",		400,	300,	setup_sine },
+	{ "fast_raster",	400,	300,	setup_fast_raster },
+	{ "ticks_none",		 40,	 40,	setup_ticks_none },
+	{ "ticks_one",		 80,	120,	setup_ticks_one },
+	{ "zero_spread",	400,	300,	setup_zero_spread },
+	{ "nan",		400,	300,	setup_nan },
+	{ "empty",		400,	300,	setup_empty },
+	{ "overlays",		400,	300,	setup_overlays },
+	{ "huge",		800,	600,	setup_huge },
+};
+
+static int bless = 0;
+static double slower = CHECK_SLOWER;
+static int skipped = 0;
+
+
+static double
+wave(size_t i, size_t len)
+{
+	return sin(i * 12.0 / len) + 0.2 * sin(i * 250.0 / len);
+}
+
+
+/**
+ * Give the chart len points of f, with limits fitting them.
+ */
+static void
+make_data(chq_dataplot_t *chart, double **x, double **y, size_t len,
+		double (*f)(size_t, size_t))
+{
+	size_t i;
+
+	*x = malloc(sizeof(double) * (len ? len : 1));
+	*y = malloc(sizeof(double) * (len ? len : 1));
+	for (i = 0; i < len; i++) {
+		(*x)[i] = i;
+		(*y)[i] = f(i, len);
+	}
+
+	chq_dataplot_set_data(chart, *x, *y, len);
+	chq_axis_set_limit(chart->x_axis, 0, len > 1 ? len - 1 : 1);
+	chq_axis_set_limit(chart->y_axis, -1.2, 1.2);
+}
+
+
+static void
+setup_sine(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 1000, wave);
+}
+
+
+static void
+setup_fast_raster(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 1000, wave);
+	chq_dataplot_set_fast_raster(chart, 1);
+}
+
+
+/* Too small for any tick. */
+static void
+setup_ticks_none(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 100, wave);
+}
+
+
+/* A single tick on the X axis. */
+static void
+setup_ticks_one(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 100, wave);
+}
+
+
+static void
+setup_zero_spread(chq_dataplot_t *chart, double **x, double **y)
+{
+	size_t i;
+
+	make_data(chart, x, y, 100, wave);
+	for (i = 0; i < 100; i++)
+		(*y)[i] = 3.0;
+	chq_axis_set_limit(chart->y_axis, 3.0, 3.0);
+}
+
+
+static void
+setup_nan(chq_dataplot_t *chart, double **x, double **y)
+{
+	size_t i;
+
+	make_data(chart, x, y, 1000, wave);
+	for (i = 0; i < 1000; i += 37)
+		(*y)[i] = NAN;
+	(*x)[500] = NAN;
+}
+
+
+static void
+setup_empty(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 0, wave);
+}
+
+
+static void
+setup_overlays(chq_dataplot_t *chart, double **x, double **y)
+{
+	chq_overlay_t *overlay;
+
+	make_data(chart, x, y, 5000, wave);
+	chq_dataplot_add_overlay(chart, CHQ_OVERLAY_ENVELOPE, 200);
+	overlay = chq_dataplot_add_overlay(chart, CHQ_OVERLAY_PERCENTILES,
+			200);
+	chq_overlay_set_percentiles(overlay, 0.25, 0.75);
+	chq_dataplot_add_overlay(chart, CHQ_OVERLAY_MEAN, 200);
+}
+
+
+static void
+setup_huge(chq_dataplot_t *chart, double **x, double **y)
+{
+	make_data(chart, x, y, 10000000, wave);
+}
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int
+check_axis(chq_axis_t *axis)
+{
+	unsigned int i;
+
+	if (!isfinite(axis->size) || !isfinite(axis->ticks_value_spacing))
+		return -1;
+	for (i = 0; i < axis->ticks_count; i++)
+		if (!isfinite(axis->ticks_positions[i]) ||
+		    axis->ticks_labels[i] == NULL)
+			return -1;
+
+	return 0;
+}
+
+
+/**
+ * Check what should hold for any chart, prints the problem if not.
+ */
+static int
+check_sanity(chq_dataplot_t *chart, cairo_t *cr)
+{
+	size_t i;
+
+	if (cairo_status(cr) != CAIRO_STATUS_SUCCESS) {
+		printf(" cairo: %s", cairo_status_to_string(cairo_status(cr)));
+		return -1;
+	}
+	if (check_axis(chart->x_axis) == -1 ||
+	    check_axis(chart->y_axis) == -1) {
+		printf(" axes not finite");
+		return -1;
+	}
+	for (i = 0; i < chart->reduce->len; i++) {
+		if (!isfinite(chart->reduce->x[i]) ||
+		    !isfinite(chart->reduce->y[i])) {
+			printf(" point %zu not finite", i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Count the pixels of a and b (of the same size) with a channel off by more
+ * than tolerance, the largest difference goes to worst.
+ */
+static size_t
+count_differ(cairo_surface_t *sa, cairo_surface_t *sb, int tolerance,
+		int *worst)
+{
+	unsigned char *a, *b;
+	int x, y, c, width, height, diff, stride_a, stride_b;
+	size_t differ = 0;
+
+	width = cairo_image_surface_get_width(sa);
+	height = cairo_image_surface_get_height(sa);
+	cairo_surface_flush(sa);
+	cairo_surface_flush(sb);
+	a = cairo_image_surface_get_data(sa);
+	b = cairo_image_surface_get_data(sb);
+	stride_a = cairo_image_surface_get_stride(sa);
+	stride_b = cairo_image_surface_get_stride(sb);
+
+	*worst = 0;
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			for (c = 0; c < 4; c++) {
+				diff = abs(a[y * stride_a + x * 4 + c] -
+				    b[y * stride_b + x * 4 + c]);
+				if (diff > *worst)
+					*worst = diff;
+				if (diff > tolerance)
+					break;
+			}
+			if (c < 4)
+				differ++;
+		}
+	}
+
+	return differ;
+}
+
+
+/**
+ * Compare a render to its reference, or make it the reference when
+ * blessing. Returns 0 if they match or there is no reference (counted in
+ * skipped), -1 if they differ.
+ */
+static int
+check_image(const char *name, cairo_surface_t *surface)
+{
+	char path[256];
+	cairo_surface_t *golden;
+	int width, height, worst;
+	size_t differ;
+
+	snprintf(path, sizeof(path), "golden/%s.png", name);
+
+	if (bless) {
+		mkdir("golden", 0755);
+		return cairo_surface_write_to_png(surface, path) ==
+		    CAIRO_STATUS_SUCCESS ? 0 : -1;
+	}
+
+	if (access(path, F_OK) == -1) {
+		printf(" no reference");
+		skipped++;
+		return 0;
+	}
+
+	golden = cairo_image_surface_create_from_png(path);
+	if (cairo_surface_status(golden) != CAIRO_STATUS_SUCCESS) {
+		printf(" unreadable reference");
+		cairo_surface_destroy(golden);
+		return -1;
+	}
+
+	width = cairo_image_surface_get_width(surface);
+	height = cairo_image_surface_get_height(surface);
+	if (cairo_image_surface_get_width(golden) != width ||
+	    cairo_image_surface_get_height(golden) != height ||
+	    cairo_image_surface_get_format(golden) != CAIRO_FORMAT_ARGB32) {
+		printf(" reference has another size or format");
+		cairo_surface_destroy(golden);
+		return -1;
+	}
+
+	differ = count_differ(surface, golden, CHECK_TOLERANCE, &worst);
+	cairo_surface_destroy(golden);
+
+	if (differ > CHECK_MAX_DIFF * width * height) {
+		printf(" %zu pixels differ (worst %d)", differ, worst);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Size the axes of chart as chq_dataplot_prepare_axes() would, but with
+ * labels of a fixed size, so the points do not depend on the fonts.
+ */
+static void
+fixed_axes(chq_dataplot_t *chart)
+{
+	chart->x_axis->label_max_width = CHECK_LABEL_WIDTH;
+	chart->x_axis->label_max_height = CHECK_LABEL_HEIGHT;
+	chart->y_axis->label_max_width = CHECK_LABEL_WIDTH;
+	chart->y_axis->label_max_height = CHECK_LABEL_HEIGHT;
+
+	chq_axis_set_size(chart->y_axis, chart->height - chart->margin_top -
+	    chart->margin_bottom - chart->x_axis->label_padding * 2 -
+	    CHECK_LABEL_HEIGHT);
+	chq_axis_set_size(chart->x_axis, chart->width - chart->margin_left -
+	    chart->margin_right);
+}
+
+
+/**
+ * Append the length and the points of a reducer to values, of count items
+ * in an array of size. Returns -1 if out of memory.
+ */
+static int
+collect_reduce(chq_reduce_t *reduce, double **values, size_t *count,
+		size_t *size)
+{
+	double *grown;
+	size_t i, needed = *count + 1 + reduce->len * 2;
+
+	if (needed > *size) {
+		*size = needed * 2;
+		grown = realloc(*values, sizeof(double) * *size);
+		if (grown == NULL)
+			return -1;
+		*values = grown;
+	}
+
+	(*values)[(*count)++] = reduce->len;
+	for (i = 0; i < reduce->len; i++) {
+		(*values)[(*count)++] = reduce->x[i];
+		(*values)[(*count)++] = reduce->y[i];
+	}
+
+	return 0;
+}
+
+
+/**
+ * Reduce the data of chart with fixed axes, and collect its points and
+ * those of its overlays. Returns -1 on failure.
+ */
+static int
+collect_points(chq_dataplot_t *chart, double **values, size_t *count)
+{
+	cairo_surface_t *surface;
+	chq_overlay_t *overlay;
+	size_t size = 0;
+	int error;
+
+	*values = NULL;
+	*count = 0;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+	chart->cr = cairo_create(surface);
+	fixed_axes(chart);
+
+	chq_dataplot_reduce_begin(chart, chart->reduce);
+	if (chart->store != NULL)
+		error = chq_dataplot_reduce_store(chart, chart->reduce);
+	else
+		error = chq_dataplot_reduce_range(chart, chart->reduce, 0,
+				chart->data_len, 1);
+	if (error == 0) {
+		chq_reduce_flush(chart->reduce);
+		error = collect_reduce(chart->reduce, values, count, &size);
+	}
+	for (overlay = chart->overlays; overlay != NULL && error == 0;
+	    overlay = overlay->next) {
+		chq_overlay_snapshot(overlay);
+		error = collect_reduce(overlay->outline, values, count, &size);
+		if (error == 0)
+			error = collect_reduce(overlay->shown_upper, values,
+			    count, &size);
+	}
+
+	cairo_destroy(chart->cr);
+	chart->cr = NULL;
+	cairo_surface_destroy(surface);
+
+	return error;
+}
+
+
+/**
+ * Compare the points of chart to golden/<name>.points, or write them there
+ * when blessing. Returns 0 if they match, -1 otherwise.
+ */
+static int
+check_points(const char *name, chq_dataplot_t *chart)
+{
+	char path[256];
+	FILE *fp;
+	double *values, value;
+	size_t i, j, len, count;
+	int error = 0;
+
+	if (collect_points(chart, &values, &count) == -1) {
+		printf(" cannot reduce");
+		free(values);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "golden/%s.points", name);
+
+	if (bless) {
+		mkdir("golden", 0755);
+		fp = fopen(path, "w");
+		if (fp == NULL) {
+			printf(" cannot write %s", path);
+			free(values);
+			return -1;
+		}
+		for (i = 0; i < count; i += 1 + 2 * len) {
+			len = values[i];
+			fprintf(fp, "%zu\n", len);
+			for (j = 0; j < len; j++)
+				fprintf(fp, "%.4f %.4f\n",
+				    values[i + 1 + 2 * j],
+				    values[i + 2 + 2 * j]);
+		}
+		error = fclose(fp) == 0 ? 0 : -1;
+		free(values);
+		return error;
+	}
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		printf(" no points");
+		free(values);
+		return -1;
+	}
+	for (i = 0; i < count && error == 0; i++) {
+		if (fscanf(fp, "%lf", &value) != 1) {
+			printf(" fewer points than the reference");
+			error = -1;
+		} else if (fabs(value - values[i]) > CHECK_POINTS_TOLERANCE) {
+			printf(" point value %zu is %.4f, not %.4f", i,
+			    values[i], value);
+			error = -1;
+		}
+	}
+	if (error == 0 && fscanf(fp, "%lf", &value) == 1) {
+		printf(" more points in the reference");
+		error = -1;
+	}
+	fclose(fp);
+	free(values);
+
+	return error;
+}
+
+
+/**
+ * Render a chart once on white.
+ */
+static cairo_surface_t *
+render_chart(chq_dataplot_t *chart, unsigned int width, unsigned int height)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width,
+			height);
+	cr = cairo_create(surface);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_paint(cr);
+	chq_dataplot_render(chart, cr);
+	cairo_destroy(cr);
+
+	return surface;
+}
+
+
+/**
+ * Render a case once, with or without the software rasterizer.
+ */
+static cairo_surface_t *
+render_case(const struct check_case *test, int fast_raster)
+{
+	cairo_surface_t *surface;
+	chq_dataplot_t *chart;
+	double *x = NULL, *y = NULL;
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, test->width);
+	chq_dataplot_set_height(chart, test->height);
+	test->setup(chart, &x, &y);
+	chq_dataplot_set_fast_raster(chart, fast_raster);
+
+	surface = render_chart(chart, test->width, test->height);
+
+	chq_dataplot_kill(chart);
+	free(x);
+	free(y);
+
+	return surface;
+}
+
+
+static const struct check_case *
+find_case(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++)
+		if (strcmp(corpus[i].name, name) == 0)
+			return &corpus[i];
+
+	return NULL;
+}
+
+
+/**
+ * Draw the cases through cairo and through raster.c, and compare them.
+ * Returns the number of failures.
+ */
+static int
+check_raster(void)
+{
+	static const char *names[] = { "sine", "nan", "overlays" };
+	const struct check_case *test;
+	cairo_surface_t *with_cairo, *with_raster;
+	size_t i, differ, pixels;
+	int worst, failures = 0;
+	char name[64];
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		test = find_case(names[i]);
+		with_cairo = render_case(test, 0);
+		with_raster = render_case(test, 1);
+		differ = count_differ(with_cairo, with_raster,
+				CHECK_RASTER_TOLERANCE, &worst);
+		pixels = (size_t)test->width * test->height;
+
+		snprintf(name, sizeof(name), "raster_%s", names[i]);
+		printf("%-16s %zu pixels differ from cairo (worst %d)", name,
+		    differ, worst);
+		if (differ > CHECK_RASTER_MAX_DIFF * pixels) {
+			printf(" FAIL");
+			write_failure(name, with_raster);
+			failures++;
+		}
+		printf("\n");
+
+		cairo_surface_destroy(with_cairo);
+		cairo_surface_destroy(with_raster);
+	}
+
+	return failures;
+}
+
+
+/**
+ * Make a buffer of the given type holding the values of data. The doubles
+ * are copied by chq_buffer_new(), which tells whether they have a NaN.
+ */
+static chq_buffer_t *
+make_column(const double *data, size_t len, enum column_type type)
+{
+	float *floats;
+	int64_t *integers;
+	size_t i;
+
+	switch (type) {
+	case CHQ_COLUMN_FLOAT:
+		floats = malloc(sizeof(float) * (len ? len : 1));
+		for (i = 0; i < len; i++)
+			floats[i] = data[i];
+		return chq_buffer_new_wrap(floats, type, len, free, floats);
+	case CHQ_COLUMN_INT64:
+		integers = malloc(sizeof(int64_t) * (len ? len : 1));
+		for (i = 0; i < len; i++)
+			integers[i] = data[i];
+		return chq_buffer_new_wrap(integers, type, len, free,
+		    integers);
+	case CHQ_COLUMN_DOUBLE:
+	default:
+		return chq_buffer_new(data, len);
+	}
+}
+
+
+/**
+ * Draw cases from their double arrays and from buffers of other column
+ * types, and compare them. Returns the number of failures.
+ */
+static int
+check_columns(void)
+{
+	static const char *type_names[CHQ_COLUMN_TYPES] = { "double",
+		"float", "int64" };
+	/* int64 X only where X has no NaN. */
+	static const struct {
+		const char		*name;
+		enum column_type	 type_x;
+		enum column_type	 type_y;
+	} columns[] = {
+		{ "sine",	CHQ_COLUMN_DOUBLE,	CHQ_COLUMN_DOUBLE },
+		{ "sine",	CHQ_COLUMN_FLOAT,	CHQ_COLUMN_FLOAT },
+		{ "sine",	CHQ_COLUMN_INT64,	CHQ_COLUMN_FLOAT },
+		{ "nan",	CHQ_COLUMN_DOUBLE,	CHQ_COLUMN_DOUBLE },
+		{ "nan",	CHQ_COLUMN_FLOAT,	CHQ_COLUMN_DOUBLE },
+		{ "overlays",	CHQ_COLUMN_INT64,	CHQ_COLUMN_DOUBLE },
+	};
+	const struct check_case *test;
+	cairo_surface_t *reference, *surface;
+	cairo_t *cr;
+	chq_dataplot_t *chart;
+	chq_buffer_t *buffer_x, *buffer_y;
+	double *x = NULL, *y = NULL;
+	size_t i, differ, pixels;
+	int worst, sane, failures = 0;
+	char name[64];
+
+	for (i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+		test = find_case(columns[i].name);
+		reference = render_case(test, 0);
+
+		chart = chq_dataplot_new();
+		chq_dataplot_set_width(chart, test->width);
+		chq_dataplot_set_height(chart, test->height);
+		test->setup(chart, &x, &y);
+		buffer_x = make_column(x, chart->data_len, columns[i].type_x);
+		buffer_y = make_column(y, chart->data_len, columns[i].type_y);
+		chq_dataplot_set_buffers(chart, buffer_x, buffer_y);
+		chq_buffer_unref(buffer_x);
+		chq_buffer_unref(buffer_y);
+		free(x);
+		free(y);
+
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				test->width, test->height);
+		cr = cairo_create(surface);
+		cairo_set_source_rgb(cr, 1, 1, 1);
+		cairo_paint(cr);
+		chq_dataplot_render(chart, cr);
+		differ = count_differ(reference, surface, CHECK_TOLERANCE,
+				&worst);
+		pixels = (size_t)test->width * test->height;
+
+		snprintf(name, sizeof(name), "%s_%s_%s", columns[i].name,
+		    type_names[columns[i].type_x],
+		    type_names[columns[i].type_y]);
+		printf("%-16s %zu pixels differ from double (worst %d)", name,
+		    differ, worst);
+		sane = check_sanity(chart, cr);
+		if (sane == -1 || differ > CHECK_MAX_DIFF * pixels) {
+			printf(" FAIL");
+			write_failure(name, surface);
+			failures++;
+		}
+		printf("\n");
+
+		cairo_destroy(cr);
+		chq_dataplot_kill(chart);
+		cairo_surface_destroy(reference);
+		cairo_surface_destroy(surface);
+	}
+
+	return failures;
+}
+
+
+/**
+ * Private copies are flagged finite only without NaN nor infinity, and an
+ * empty one needs no data. Returns the number of failures.
+ */
+static int
+check_buffers(void)
+{
+	static const struct {
+		const char	*name;
+		double		 values[3];
+		size_t		 len;
+		int		 finite;
+	} buffers[] = {
+		{ "buffer_finite",	{ 1.0, -2.0, 3.0 },		3, 1 },
+		{ "buffer_nan",		{ 1.0, NAN, 3.0 },		3, 0 },
+		{ "buffer_inf",		{ 1.0, 2.0, INFINITY },		3, 0 },
+		{ "buffer_minus_inf",	{ -INFINITY, 2.0, 3.0 },	3, 0 },
+		{ "buffer_empty",	{ 0.0 },			0, 1 },
+	};
+	chq_buffer_t *buffer;
+	size_t i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+		printf("%-16s", buffers[i].name);
+		buffer = chq_buffer_new(buffers[i].len > 0 ?
+		    buffers[i].values : NULL, buffers[i].len);
+		if (buffer == NULL) {
+			printf(" no buffer FAIL");
+			failures++;
+		} else if (buffer->len != buffers[i].len ||
+		    buffer->finite != buffers[i].finite) {
+			printf(" %zu values, finite %d FAIL", buffer->len,
+			    buffer->finite);
+			failures++;
+		}
+		printf("\n");
+		if (buffer != NULL)
+			chq_buffer_unref(buffer);
+	}
+
+	return failures;
+}
+
+
+/**
+ * Render two charts of the same size and limits against a layout made from
+ * the first one: each must look like its own render, and keep its own
+ * axes. Returns the number of failures.
+ */
+static int
+check_layout(void)
+{
+	static const char *names[] = { "sine", "nan" };
+	const struct check_case *test;
+	cairo_surface_t *reference, *surface;
+	cairo_t *cr;
+	chq_dataplot_t *charts[2];
+	chq_axis_t *x_axes[2];
+	chq_layout_t *layout = NULL;
+	double *x[2], *y[2];
+	size_t i, differ, pixels;
+	int worst, failures = 0;
+	char name[64];
+
+	for (i = 0; i < 2; i++) {
+		test = find_case(names[i]);
+		charts[i] = chq_dataplot_new();
+		chq_dataplot_set_width(charts[i], test->width);
+		chq_dataplot_set_height(charts[i], test->height);
+		test->setup(charts[i], &x[i], &y[i]);
+		x_axes[i] = charts[i]->x_axis;
+	}
+
+	for (i = 0; i < 2; i++) {
+		test = find_case(names[i]);
+		reference = render_chart(charts[i], test->width, test->height);
+
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				test->width, test->height);
+		cr = cairo_create(surface);
+		cairo_set_source_rgb(cr, 1, 1, 1);
+		cairo_paint(cr);
+		if (layout == NULL)
+			layout = chq_layout_new(charts[0], cr);
+		chq_dataplot_render_layout(charts[i], layout, cr);
+		cairo_destroy(cr);
+
+		differ = count_differ(reference, surface, CHECK_TOLERANCE,
+				&worst);
+		pixels = (size_t)test->width * test->height;
+		snprintf(name, sizeof(name), "layout_%s", names[i]);
+		printf("%-16s %zu pixels differ from its render (worst %d)",
+		    name, differ, worst);
+		if (differ > CHECK_MAX_DIFF * pixels ||
+		    charts[i]->x_axis != x_axes[i]) {
+			printf(" FAIL");
+			write_failure(name, surface);
+			failures++;
+		}
+		printf("\n");
+
+		cairo_surface_destroy(reference);
+		cairo_surface_destroy(surface);
+	}
+
+	chq_layout_kill(layout);
+	for (i = 0; i < 2; i++) {
+		chq_dataplot_kill(charts[i]);
+		free(x[i]);
+		free(y[i]);
+	}
+
+	return failures;
+}
+
+
+/**
+ * Paint a pooled surface red, give it back and acquire it again: it must be
+ * the same context, cleared to transparent unless the caller promised to
+ * paint the full frame. Returns the number of failures.
+ */
+static int
+check_pool(void)
+{
+	static const struct {
+		const char	*name;
+		int		 full_frame;
+	} cases[] = {
+		{ "pool_clear",		0 },
+		{ "pool_full_frame",	1 },
+	};
+	cairo_surface_t *expected;
+	cairo_t *cr, *again, *ref;
+	chq_pool_t *pool;
+	size_t i, differ;
+	int worst, failures = 0;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		pool = chq_pool_new(1);
+		cr = chq_pool_acquire(pool, CAIRO_FORMAT_ARGB32, 16, 16, 0);
+		cairo_set_source_rgb(cr, 1, 0, 0);
+		cairo_paint(cr);
+		chq_pool_release(pool, cr);
+
+		expected = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				16, 16);
+		if (cases[i].full_frame) {
+			ref = cairo_create(expected);
+			cairo_set_source_rgb(ref, 1, 0, 0);
+			cairo_paint(ref);
+			cairo_destroy(ref);
+		}
+
+		again = chq_pool_acquire(pool, CAIRO_FORMAT_ARGB32, 16, 16,
+				cases[i].full_frame);
+		differ = count_differ(expected, cairo_get_target(again), 0,
+				&worst);
+		printf("%-16s %zu pixels differ (worst %d)", cases[i].name,
+		    differ, worst);
+		if (again != cr || differ > 0) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+
+		chq_pool_release(pool, again);
+		cairo_surface_destroy(expected);
+		chq_pool_kill(pool);
+	}
+
+	return failures;
+}
+
+
+/**
+ * Reduce data given as buffers of each column type, so that every family of
+ * kernels runs, and compare their points to golden/kernel_<name>.points.
+ * Returns the number of failures.
+ */
+static int
+check_kernels(void)
+{
+	/* Y is scaled so the int64 columns keep some shape. */
+	static const struct {
+		const char		*kernel;
+		enum column_type	 type_x;
+		enum column_type	 type_y;
+		int			 nan;
+		int			 overlays;
+	} kernels[] = {
+		{ "double_double_finite", CHQ_COLUMN_DOUBLE,
+		    CHQ_COLUMN_DOUBLE, 0, 0 },
+		{ "double_double", CHQ_COLUMN_DOUBLE, CHQ_COLUMN_DOUBLE, 1, 0 },
+		{ "float_float", CHQ_COLUMN_FLOAT, CHQ_COLUMN_FLOAT, 1, 0 },
+		{ "double_float", CHQ_COLUMN_DOUBLE, CHQ_COLUMN_FLOAT, 0, 0 },
+		{ "int64_int64_finite", CHQ_COLUMN_INT64, CHQ_COLUMN_INT64, 0,
+		    0 },
+		{ "int64_float", CHQ_COLUMN_INT64, CHQ_COLUMN_FLOAT, 1, 0 },
+		{ "double_double_finite_overlays", CHQ_COLUMN_DOUBLE,
+		    CHQ_COLUMN_DOUBLE, 0, 1 },
+		{ "int64_double_overlays", CHQ_COLUMN_INT64,
+		    CHQ_COLUMN_DOUBLE, 1, 1 },
+	};
+	const size_t len = 3000;
+	chq_dataplot_t *chart;
+	chq_buffer_t *buffer_x, *buffer_y;
+	chq_kernel_t kernel;
+	double *x, *y;
+	size_t i, j;
+	int finite, failures = 0;
+	char name[64];
+
+	x = malloc(sizeof(double) * len);
+	y = malloc(sizeof(double) * len);
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		for (j = 0; j < len; j++) {
+			x[j] = j;
+			y[j] = kernels[i].nan && j % 37 == 0 ? NAN :
+				wave(j, len) * 1000.0;
+		}
+
+		chart = chq_dataplot_new();
+		chq_dataplot_set_width(chart, 400);
+		chq_dataplot_set_height(chart, 300);
+		buffer_x = make_column(x, len, kernels[i].type_x);
+		buffer_y = make_column(y, len, kernels[i].type_y);
+		chq_dataplot_set_buffers(chart, buffer_x, buffer_y);
+		chq_buffer_unref(buffer_x);
+		chq_buffer_unref(buffer_y);
+		chq_axis_set_limit(chart->x_axis, 0, len - 1);
+		chq_axis_set_limit(chart->y_axis, -1200, 1200);
+		if (kernels[i].overlays) {
+			chq_dataplot_add_overlay(chart, CHQ_OVERLAY_ENVELOPE,
+			    100);
+			chq_dataplot_add_overlay(chart, CHQ_OVERLAY_MEAN, 100);
+		}
+
+		snprintf(name, sizeof(name), "kernel_%s", kernels[i].kernel);
+		printf("%-16s", name);
+
+		/* The same choice as chq_dataplot_reduce_range(). */
+		fixed_axes(chart);
+		finite = chart->buffer_x->finite && chart->buffer_y->finite;
+		chq_kernel_setup(&kernel, chart, chart->overlays,
+		    chart->type_x, chart->type_y, finite);
+		if (strcmp(kernel.name, kernels[i].kernel) != 0) {
+			printf(" runs %s FAIL", kernel.name);
+			failures++;
+		} else if (check_points(name, chart) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+
+		chq_dataplot_kill(chart);
+	}
+
+	free(x);
+	free(y);
+
+	return failures;
+}
+
+
+static double
+store_x_delta(size_t i)
+{
+	/* Timestamps going back and forth, deltas need a sign. */
+	return 1099511627776.0 + (double)(i * 1000) +
+		(i % 2 ? -1500.0 : 0.0);
+}
+
+
+static double
+store_x_fraction(size_t i)
+{
+	return i * 0.5 + 0.25;
+}
+
+
+static double
+store_x_nan(size_t i)
+{
+	return i == 300 ? NAN : (double)i;
+}
+
+
+static int
+same_value(double a, double b)
+{
+	return (isnan(a) && isnan(b)) || a == b;
+}
+
+
+/**
+ * Write a series file in pieces that do not line up with its chunks, read
+ * it back and compare. Returns -1 on failure.
+ */
+static int
+check_store_file(const char *path, size_t rows, unsigned int chunk_rows,
+		double (*f)(size_t))
+{
+	chq_store_writer_t *writer;
+	chq_store_t *store;
+	const double *x, *y;
+	double *data_x, *data_y;
+	size_t i, j, len, row = 0;
+	int error = 0;
+
+	data_x = malloc(sizeof(double) * rows);
+	data_y = malloc(sizeof(double) * rows);
+	for (i = 0; i < rows; i++) {
+		data_x[i] = f(i);
+		data_y[i] = i % 53 == 0 ? NAN : wave(i, rows);
+	}
+
+	writer = chq_store_writer_new(path, chunk_rows);
+	if (writer == NULL) {
+		printf(" cannot create %s", path);
+		free(data_x);
+		free(data_y);
+		return -1;
+	}
+	for (i = 0; i < rows && error == 0; i += 37)
+		error = chq_store_writer_append(writer, data_x + i,
+		    data_y + i, rows - i < 37 ? rows - i : 37);
+	if (chq_store_writer_close(writer) == -1 || error == -1) {
+		printf(" cannot write %s", path);
+		free(data_x);
+		free(data_y);
+		return -1;
+	}
+
+	store = chq_store_open(path);
+	if (store == NULL) {
+		printf(" cannot open %s", path);
+		error = -1;
+	} else if (store->rows != rows ||
+	    store->chunks_count != (rows + chunk_rows - 1) / chunk_rows) {
+		printf(" %llu rows in %llu chunks",
+		    (unsigned long long)store->rows,
+		    (unsigned long long)store->chunks_count);
+		error = -1;
+	}
+	for (i = 0; error == 0 && i < store->chunks_count; i++) {
+		len = chq_store_read(store, i, &x, &y);
+		if (len == 0 || row + len > rows) {
+			printf(" chunk %zu unreadable", i);
+			error = -1;
+		}
+		for (j = 0; error == 0 && j < len; j++, row++) {
+			if (!same_value(x[j], data_x[row]) ||
+			    !same_value(y[j], data_y[row])) {
+				printf(" row %zu is %.17g,%.17g not %.17g,%.17g",
+				    row, x[j], y[j], data_x[row], data_y[row]);
+				error = -1;
+			}
+		}
+	}
+	if (error == 0 && row != rows) {
+		printf(" %zu rows read", row);
+		error = -1;
+	}
+
+	if (store != NULL)
+		chq_store_kill(store);
+	unlink(path);
+	free(data_x);
+	free(data_y);
+
+	return error;
+}
+
+
+/**
+ * Render a series file with and without the zone map shortcut, which must
+ * not change the points nor the image. Returns -1 on failure.
+ */
+static int
+check_store_stats(const char *path, double from, double to)
+{
+	const size_t rows = 200000;
+	chq_dataplot_t *chart;
+	chq_store_t *store;
+	cairo_surface_t *surface[2];
+	double *data_x, *data_y, *values[2];
+	size_t i, count[2];
+	int worst, error = 0;
+
+	data_x = malloc(sizeof(double) * rows);
+	data_y = malloc(sizeof(double) * rows);
+	for (i = 0; i < rows; i++) {
+		/* Noisy, so chunks have their extremes inside. */
+		data_x[i] = i;
+		data_y[i] = wave(i, rows) + 0.1 * sin(i * 2.7);
+	}
+	error = chq_store_write(path, data_x, data_y, rows, 64);
+	free(data_x);
+	free(data_y);
+	store = error == 0 ? chq_store_open(path) : NULL;
+	if (store == NULL) {
+		printf(" cannot write %s", path);
+		unlink(path);
+		return -1;
+	}
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, 400);
+	chq_dataplot_set_height(chart, 300);
+	chq_dataplot_set_store(chart, store);
+	chq_axis_set_limit(chart->x_axis, from, to);
+	chq_axis_set_limit(chart->y_axis, -1.2, 1.2);
+
+	for (i = 0; i < 2; i++) {
+		store->stats = i == 0;
+		surface[i] = render_chart(chart, 400, 300);
+		if (collect_points(chart, &values[i], &count[i]) == -1)
+			error = -1;
+	}
+
+	if (error == -1) {
+		printf(" cannot reduce");
+	} else if (count[0] != count[1] || memcmp(values[0], values[1],
+	    sizeof(double) * count[0]) != 0) {
+		printf(" points differ");
+		error = -1;
+	} else if (count_differ(surface[0], surface[1], 0, &worst) > 0) {
+		printf(" images differ (worst %d)", worst);
+		error = -1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		free(values[i]);
+		cairo_surface_destroy(surface[i]);
+	}
+	chq_dataplot_kill(chart);
+	chq_store_kill(store);
+	unlink(path);
+
+	return error;
+}
+
+
+/**
+ * Series files: round trips of packed (delta, zigzag) and raw X columns,
+ * with NaN rows and chunk boundaries, and the zone map shortcut. Returns
+ * the number of failures.
+ */
+static int
+check_store(void)
+{
+	static const struct {
+		const char	*name;
+		size_t		 rows;
+		unsigned int	 chunk_rows;
+		double		(*f)(size_t);
+	} files[] = {
+		{ "store_delta",	1000,	128,	store_x_delta },
+		{ "store_exact",	1024,	128,	store_x_delta },
+		{ "store_single",	1,	128,	store_x_delta },
+		{ "store_fraction",	1000,	100,	store_x_fraction },
+		{ "store_nan_x",	1000,	128,	store_x_nan },
+	};
+	static const struct {
+		const char	*name;
+		double		 from;
+		double		 to;
+	} views[] = {
+		{ "store_stats",	0,	199999 },
+		{ "store_stats_view",	50000,	130000 },
+	};
+	size_t i;
+	int error, failures = 0;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		printf("%-16s", files[i].name);
+		error = check_store_file(CHECK_STORE, files[i].rows,
+		    files[i].chunk_rows, files[i].f);
+		if (error == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	for (i = 0; i < sizeof(views) / sizeof(views[0]); i++) {
+		printf("%-16s", views[i].name);
+		if (check_store_stats(CHECK_STORE, views[i].from,
+		    views[i].to) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+/**
+ * Monthly ticks on the first at midnight, the year shown on the first tick
+ * and in January only.
+ */
+static int
+time_tick_month(const struct tm *tm, const char *label, unsigned int i)
+{
+	char expected[32];
+
+	if (tm->tm_mday != 1 || tm->tm_hour != 0 || tm->tm_min != 0 ||
+	    tm->tm_sec != 0)
+		return -1;
+	if (i == 0 || tm->tm_mon == 0)
+		snprintf(expected, sizeof(expected), "%04d-%02d",
+		    tm->tm_year + 1900, tm->tm_mon + 1);
+	else
+		snprintf(expected, sizeof(expected), "%02d", tm->tm_mon + 1);
+
+	return strcmp(label, expected) == 0 ? 0 : -1;
+}
+
+
+static int
+time_tick_monday(const struct tm *tm, const char *label, unsigned int i)
+{
+	(void)label;
+	(void)i;
+
+	return tm->tm_wday == 1 && tm->tm_hour == 0 && tm->tm_min == 0 &&
+	    tm->tm_sec == 0 ? 0 : -1;
+}
+
+
+static int
+time_tick_second(const struct tm *tm, const char *label, unsigned int i)
+{
+	char expected[16];
+	size_t len = strlen(label);
+
+	(void)i;
+	snprintf(expected, sizeof(expected), ":%02d", tm->tm_sec);
+
+	return len >= 3 && strcmp(label + len - 3, expected) == 0 ? 0 : -1;
+}
+
+
+/**
+ * Make the calendar ticks of a time axis 800 pixels wide, with fixed label
+ * sizes, and check that they are spacing seconds apart (an average month
+ * for monthly ticks), and each of them with tick(). With no tick function,
+ * the limits must be too close for calendar ticks.
+ */
+static int
+check_time_axis(double from, double to, double spacing,
+		int (*tick)(const struct tm *, const char *, unsigned int))
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	chq_axis_t *axis;
+	struct tm tm;
+	time_t value;
+	unsigned int i;
+	int error = 0;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+	cr = cairo_create(surface);
+	axis = chq_axis_horizontal_new();
+	chq_axis_set_type(axis, CHQ_AXIS_TIME);
+	chq_axis_set_limit(axis, from, to);
+	chq_axis_calculate_label_size(axis, cr);
+	for (i = 0; i < CHQ_TIME_FIELDS; i++)
+		axis->label_cache->label_widths[i] = CHECK_LABEL_WIDTH;
+	chq_axis_set_size(axis, 800);
+
+	if (tick == NULL) {
+		if (chq_axis_time_prerender_ticks(axis) != -1) {
+			printf(" calendar ticks");
+			error = -1;
+		}
+		/* The plain ticks take over. */
+		chq_axis_prerender_ticks(axis, cr);
+		if (error == 0 && (axis->ticks_count < 2 ||
+		    axis->ticks_labels[0] == NULL)) {
+			printf(" no plain ticks");
+			error = -1;
+		}
+	} else if (chq_axis_time_prerender_ticks(axis) == -1 ||
+	    axis->ticks_count < 2) {
+		printf(" no calendar ticks");
+		error = -1;
+	} else if (axis->ticks_value_spacing != spacing) {
+		printf(" step %g not %g", axis->ticks_value_spacing, spacing);
+		error = -1;
+	}
+
+	for (i = 0; tick != NULL && error == 0 && i < axis->ticks_count;
+	    i++) {
+		value = (time_t)floor(chq_axis_convert_from_scale(axis,
+				axis->ticks_positions[i]) + 0.5);
+		gmtime_r(&value, &tm);
+		if (value < from || value > to ||
+		    tick(&tm, axis->ticks_labels[i], i) == -1) {
+			printf(" tick %u at %lld is \"%s\"", i,
+			    (long long)value, axis->ticks_labels[i]);
+			error = -1;
+		}
+	}
+
+	chq_axis_kill(axis);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	return error;
+}
+
+
+/**
+ * Calendar ticks: whole months across a new year, weeks on Mondays, seconds,
+ * and limits too close for them. Returns the number of failures.
+ */
+static int
+check_time(void)
+{
+	static const struct {
+		const char	*name;
+		double		 from;
+		double		 to;
+		double		 spacing;
+		int		(*tick)(const struct tm *, const char *,
+					unsigned int);
+	} cases[] = {
+		/* 2023-11-15 to 2024-04-20 */
+		{ "time_months",	1700006400.0,	1713571200.0,
+		    30.436875 * 86400.0, time_tick_month },
+		/* 2024-01-03 (a Wednesday) to 2024-02-28 */
+		{ "time_weeks",		1704240000.0,	1709078400.0,
+		    7 * 86400.0, time_tick_monday },
+		{ "time_seconds",	1700000001.0,	1700000041.0,	5.0,
+		    time_tick_second },
+		{ "time_too_close",	1700000000.0,	1700000001.5,	0.0,
+		    NULL },
+	};
+	size_t i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		printf("%-16s", cases[i].name);
+		if (check_time_axis(cases[i].from, cases[i].to,
+		    cases[i].spacing, cases[i].tick) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+/**
+ * Render a grid of four corpus charts, sharing the x and/or y axes, once
+ * straight into an image (the threaded path) and once through a
+ * translation (a cell at a time, transformed and clipped): the two must
+ * look the same, and the axes of the charts that are not shared must be
+ * left as their own render made them. Returns 0 or -1.
+ */
+static int
+check_grid_render(int share_x, int share_y)
+{
+	static const char *names[] = { "sine", "nan", "overlays",
+		"zero_spread" };
+	const unsigned int width = 600, height = 400, offset = 8;
+	const struct check_case *test;
+	chq_dataplot_t *charts[4];
+	chq_grid_t *grid;
+	cairo_surface_t *direct, *shifted, *view;
+	cairo_t *cr;
+	double *x[4], *y[4], sizes[4][2];
+	size_t i, differ;
+	int worst, error = 0;
+
+	grid = chq_grid_new(2, 2);
+	chq_grid_set_size(grid, width, height);
+	chq_grid_set_shared(grid, share_x, share_y);
+	chq_axis_set_limit(grid->x_axis, 0, 999);
+	chq_axis_set_limit(grid->y_axis, -1.2, 1.2);
+	/* Threads even on a single CPU. */
+	grid->threads = 2;
+
+	for (i = 0; i < 4; i++) {
+		test = find_case(names[i]);
+		charts[i] = chq_dataplot_new();
+		chq_dataplot_set_width(charts[i], test->width);
+		chq_dataplot_set_height(charts[i], test->height);
+		x[i] = y[i] = NULL;
+		test->setup(charts[i], &x[i], &y[i]);
+		cairo_surface_destroy(render_chart(charts[i], test->width,
+		    test->height));
+		sizes[i][0] = charts[i]->x_axis->size;
+		sizes[i][1] = charts[i]->y_axis->size;
+		chq_grid_set_cell(grid, i % 2, i / 2, charts[i]);
+	}
+
+	direct = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width,
+			height);
+	cr = cairo_create(direct);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_paint(cr);
+	chq_grid_render(grid, cr);
+	cairo_destroy(cr);
+
+	shifted = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			width + offset, height + offset);
+	cr = cairo_create(shifted);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_paint(cr);
+	cairo_translate(cr, offset, offset);
+	chq_grid_render(grid, cr);
+	cairo_destroy(cr);
+
+	cairo_surface_flush(shifted);
+	view = cairo_image_surface_create_for_data(
+			cairo_image_surface_get_data(shifted) +
+			offset * cairo_image_surface_get_stride(shifted) +
+			offset * 4, CAIRO_FORMAT_ARGB32, width, height,
+			cairo_image_surface_get_stride(shifted));
+	differ = count_differ(direct, view, CHECK_TOLERANCE, &worst);
+	printf(" %zu pixels differ from the threads (worst %d)", differ,
+	    worst);
+	if (differ > CHECK_MAX_DIFF * width * height)
+		error = -1;
+
+	for (i = 0; i < 4; i++) {
+		if (charts[i]->x_axis->size != sizes[i][0] ||
+		    charts[i]->y_axis->size != sizes[i][1]) {
+			printf(", %s axes resized", names[i]);
+			error = -1;
+		}
+	}
+
+	cairo_surface_destroy(view);
+	cairo_surface_destroy(shifted);
+	cairo_surface_destroy(direct);
+	for (i = 0; i < 4; i++) {
+		chq_dataplot_kill(charts[i]);
+		free(x[i]);
+		free(y[i]);
+	}
+	chq_grid_kill(grid);
+
+	return error;
+}
+
+
+/**
+ * Grids sharing either axis, see check_grid_render(). Returns the number of
+ * failures.
+ */
+static int
+check_grid(void)
+{
+	static const struct {
+		const char	*name;
+		int		 share_x;
+		int		 share_y;
+	} grids[] = {
+		{ "grid_shared_x",	1,	0 },
+		{ "grid_shared_y",	0,	1 },
+	};
+	size_t i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(grids) / sizeof(grids[0]); i++) {
+		printf("%-16s", grids[i].name);
+		if (check_grid_render(grids[i].share_x,
+		    grids[i].share_y) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+/**
+ * Write text to path, open it as a CSV file and read the columns called x
+ * and y: there must be rows of them, alike the strings of expected (x and
+ * y of each row, as strtod(3) reads them). Returns 0 or -1.
+ */
+static int
+check_csv_file(const char *path, const char *text, const char *x,
+		const char *y, size_t rows, const char **expected)
+{
+	chq_csv_t *csv;
+	FILE *fp;
+	double *data_x, *data_y, value;
+	size_t len, i;
+	int x_col, y_col, error = 0;
+
+	fp = fopen(path, "w");
+	if (fp == NULL || fputs(text, fp) == EOF || fclose(fp) == EOF) {
+		printf(" cannot write %s", path);
+		return -1;
+	}
+
+	csv = chq_csv_open(path);
+	if (csv == NULL) {
+		printf(" cannot open");
+		unlink(path);
+		return -1;
+	}
+
+	x_col = chq_csv_get_column(csv, x);
+	y_col = chq_csv_get_column(csv, y);
+	if (x_col == -1 || y_col == -1) {
+		printf(" no column %s or %s", x, y);
+		chq_csv_kill(csv);
+		unlink(path);
+		return -1;
+	}
+
+	len = chq_csv_read_columns(csv, x_col, y_col, &data_x, &data_y);
+	if (len != rows) {
+		printf(" %zu rows not %zu", len, rows);
+		error = -1;
+	}
+	for (i = 0; error == 0 && i < rows * 2; i++) {
+		value = strtod(expected[i], NULL);
+		if (!same_value(i % 2 ? data_y[i / 2] : data_x[i / 2],
+		    value)) {
+			printf(" row %zu is %.17g,%.17g not %s,%s", i / 2,
+			    data_x[i / 2], data_y[i / 2], expected[i & ~1],
+			    expected[i | 1]);
+			error = -1;
+		}
+	}
+
+	free(data_x);
+	free(data_y);
+	chq_csv_kill(csv);
+	unlink(path);
+
+	return error;
+}
+
+
+/**
+ * The CSV reader: quoted fields and names, TSV, CRLF line ends and empty
+ * lines, and integers too large for a double to hold them all, which must
+ * round as strtod(3) does. Returns the number of failures.
+ */
+static int
+check_csv(void)
+{
+	static const char *quoted[] = { "1", "10", "2", "-2.5" };
+	static const char *tsv[] = { "1", "10", "2", "20" };
+	static const char *crlf[] = { "1", "10", "2", "20", "3", "30" };
+	static const char *large[] = {
+		"9007199254740993", "1",
+		"-12345678901234567", "2",
+		"1844674407370955161", "3",
+		"0.1", "9007199254740995",
+	};
+	static const struct {
+		const char	*name;
+		const char	*text;
+		const char	*x;
+		const char	*y;
+		size_t		 rows;
+		const char	**expected;
+	} files[] = {
+		{ "csv_quoted", "\"label, long\",\"x\",\"y\"\n"
+		    "\"a, b\",1,10\n\"c\",\"2\",\"-2.5\"\n",
+		    "x", "y", 2, quoted },
+		{ "csv_tsv", "label\tx\ty\na, b\t1\t10\nc\t2\t20\n",
+		    "x", "y", 2, tsv },
+		{ "csv_crlf", "x,y\r\n1,10\r\n2,20\r\n\r\n3,30\r\n",
+		    "x", "y", 3, crlf },
+		{ "csv_large", "9007199254740993,1\n-12345678901234567,2\n"
+		    "1844674407370955161,3\n0.1,9007199254740995\n",
+		    "1", "2", 4, large },
+	};
+	size_t i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		printf("%-16s", files[i].name);
+		if (check_csv_file(CHECK_CSV, files[i].text, files[i].x,
+		    files[i].y, files[i].rows, files[i].expected) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+/**
+ * Cancel callback giving up on its call number *data (counting down).
+ */
+static int
+cancel_after(void *data)
+{
+	int *calls = data;
+
+	return --*calls == 0;
+}
+
+
+/**
+ * A progressive render cancelled in the middle of the data, then resumed
+ * until done, must end with the points of a plain render. Returns the
+ * number of failures.
+ */
+static int
+check_progressive(void)
+{
+	const size_t rows = 1000000;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	chq_dataplot_t *chart;
+	double *x, *y, *values;
+	size_t len;
+	int calls = 20, status, error = 0;
+
+	printf("%-16s", "progressive");
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, 400);
+	chq_dataplot_set_height(chart, 300);
+	make_data(chart, &x, &y, rows, wave);
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 400, 300);
+	cr = cairo_create(surface);
+
+	chq_dataplot_set_cancel(chart, cancel_after, &calls);
+	status = chq_dataplot_render_progressive(chart, cr, 1e9);
+	chq_dataplot_set_cancel(chart, NULL, NULL);
+	if (status != CHQ_RENDER_MORE) {
+		printf(" not cancelled");
+		error = -1;
+	}
+	while (status == CHQ_RENDER_MORE)
+		status = chq_dataplot_render_progressive(chart, cr, 1e9);
+
+	len = chart->reduce->len;
+	values = malloc(sizeof(double) * 2 * (len ? len : 1));
+	memcpy(values, chart->reduce->x, sizeof(double) * len);
+	memcpy(values + len, chart->reduce->y, sizeof(double) * len);
+
+	chq_dataplot_render(chart, cr);
+	if (error == 0 && (chart->reduce->len != len ||
+	    memcmp(values, chart->reduce->x, sizeof(double) * len) != 0 ||
+	    memcmp(values + len, chart->reduce->y,
+	    sizeof(double) * len) != 0)) {
+		printf(" %zu points, not those of a render (%zu)", len,
+		    chart->reduce->len);
+		error = -1;
+	}
+
+	free(values);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	chq_dataplot_kill(chart);
+	free(x);
+	free(y);
+
+	if (error == -1)
+		printf(" FAIL");
+	printf("\n");
+
+	return error == -1 ? 1 : 0;
+}
+
+
+static double
+pick_x_sorted(size_t i)
+{
+	return i;
+}
+
+
+/* The first middle of a binary search over the 1001 points is a NaN. */
+static double
+pick_x_nan(size_t i)
+{
+	return i == 500 ? NAN : (double)i;
+}
+
+
+static double
+pick_x_scatter(size_t i)
+{
+	return i * 7919 % 1001;
+}
+
+
+/**
+ * Pick around every 37th point of a chart of 1001 points with X from x(),
+ * prepared as a worker would: the point found must be the nearest one, or
+ * as near within a pixel for the grid. Returns 0 or -1.
+ */
+static int
+check_pick_chart(double (*x)(size_t))
+{
+	const size_t rows = 1001;
+	cairo_surface_t *surface;
+	chq_dataplot_t *chart;
+	double *data_x, *data_y, left, top, px, py, dx, dy, d, best, found;
+	size_t i, j, index;
+	int error = 0;
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, 400);
+	chq_dataplot_set_height(chart, 300);
+	make_data(chart, &data_x, &data_y, rows, wave);
+	for (i = 0; i < rows; i++)
+		data_x[i] = x(i);
+	surface = render_chart(chart, 400, 300);
+	chq_dataplot_pick_prepare(chart);
+
+	left = chart->margin_left + chq_axis_vertical_get_width(chart->y_axis);
+	top = chart->margin_top;
+
+	for (j = 1; error == 0 && j < rows; j += 37) {
+		if (isnan(data_x[j]))
+			continue;
+		px = left + chq_axis_convert_to_scale(chart->x_axis,
+				data_x[j]) + 0.3;
+		py = top + chq_axis_convert_to_scale(chart->y_axis,
+				data_y[j]) - 0.2;
+
+		best = INFINITY;
+		for (i = 0; i < rows; i++) {
+			dx = left + chq_axis_convert_to_scale(chart->x_axis,
+					data_x[i]) - px;
+			dy = top + chq_axis_convert_to_scale(chart->y_axis,
+					data_y[i]) - py;
+			d = hypot(dx, dy);
+			if (d < best)
+				best = d;
+		}
+
+		if (chq_dataplot_pick(chart, px, py, CHECK_PICK_RADIUS,
+		    &index) == -1) {
+			printf(" nothing near point %zu", j);
+			error = -1;
+			break;
+		}
+		found = hypot(left + chq_axis_convert_to_scale(chart->x_axis,
+		    data_x[index]) - px, top + chq_axis_convert_to_scale(
+		    chart->y_axis, data_y[index]) - py);
+		if (found > best + (chart->pick->sorted ? 0.0 : M_SQRT2)) {
+			printf(" point %zu found %zu, %g pixels away not %g",
+			    j, index, found, best);
+			error = -1;
+		}
+	}
+
+	cairo_surface_destroy(surface);
+	chq_dataplot_kill(chart);
+	free(data_x);
+	free(data_y);
+
+	return error;
+}
+
+
+/**
+ * Nearest point queries, on sorted X (binary search), sorted X with a NaN,
+ * and a scatter (grid). Returns the number of failures.
+ */
+static int
+check_pick(void)
+{
+	static const struct {
+		const char	*name;
+		double		(*x)(size_t);
+	} charts[] = {
+		{ "pick_sorted",	pick_x_sorted },
+		{ "pick_nan_x",		pick_x_nan },
+		{ "pick_scatter",	pick_x_scatter },
+	};
+	size_t i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(charts) / sizeof(charts[0]); i++) {
+		printf("%-16s", charts[i].name);
+		if (check_pick_chart(charts[i].x) == -1) {
+			printf(" FAIL");
+			failures++;
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+/**
+ * Export a chart of len points with render() and read the file back: it
+ * must hold marker, its size is returned in size. Returns -1 on failure.
+ */
+static int
+check_vector_file(int (*render)(chq_dataplot_t *, const char *),
+		const char *path, const char *marker, size_t len, long *size)
+{
+	chq_dataplot_t *chart;
+	double *x, *y;
+	char *text = NULL;
+	FILE *fp = NULL;
+	int error = 0;
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, 400);
+	chq_dataplot_set_height(chart, 300);
+	make_data(chart, &x, &y, len, wave);
+
+	if (render(chart, path) == -1 || (fp = fopen(path, "r")) == NULL) {
+		printf(" cannot write %s", path);
+		error = -1;
+	} else if (fseek(fp, 0, SEEK_END) == -1 || (*size = ftell(fp)) <= 0) {
+		printf(" %s is empty", path);
+		error = -1;
+	} else {
+		text = calloc(1, *size + 1);
+		rewind(fp);
+		if (text == NULL ||
+		    fread(text, 1, *size, fp) != (size_t)*size) {
+			printf(" cannot read %s", path);
+			error = -1;
+		} else if (strstr(text, marker) == NULL) {
+			printf(" no %s in %s", marker, path);
+			error = -1;
+		}
+	}
+
+	if (fp != NULL)
+		fclose(fp);
+	free(text);
+	unlink(path);
+	chq_dataplot_kill(chart);
+	free(x);
+	free(y);
+
+	return error;
+}
+
+
+/**
+ * Vector exports: the files must be valid (an SVG shows its labels with
+ * glyph definitions, not outlines), and a hundred times the points of the
+ * same curve must not make them grow by more than CHECK_VECTOR_GROWTH.
+ * Returns the number of failures.
+ */
+static int
+check_vector(void)
+{
+	static const struct {
+		const char	*name;
+		int		(*render)(chq_dataplot_t *, const char *);
+		const char	*path;
+		const char	*marker;
+		int		 supported;
+	} formats[] = {
+		{ "vector_svg",	chq_dataplot_render_svg, "check.svg",
+		    "id=\"glyph",	CHECK_HAS_SVG },
+		{ "vector_pdf",	chq_dataplot_render_pdf, "check.pdf",
+		    "%PDF-",	CHECK_HAS_PDF },
+	};
+	size_t i;
+	long small, large;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		printf("%-16s", formats[i].name);
+		if (!formats[i].supported) {
+			printf(" not built in cairo, skipped\n");
+			continue;
+		}
+		if (check_vector_file(formats[i].render, formats[i].path,
+		    formats[i].marker, 10000, &small) == -1 ||
+		    check_vector_file(formats[i].render, formats[i].path,
+		    formats[i].marker, 1000000, &large) == -1) {
+			printf(" FAIL");
+			failures++;
+		} else {
+			printf(" %ld bytes, %ld for 100x the points", small,
+			    large);
+			if (large > small * CHECK_VECTOR_GROWTH) {
+				printf(" FAIL");
+				failures++;
+			}
+		}
+		printf("\n");
+	}
+
+	return failures;
+}
+
+
+static void
+write_failure(const char *name, cairo_surface_t *surface)
+{
+	char path[256];
+
+	mkdir("out", 0755);
+	snprintf(path, sizeof(path), "out/%s.png", name);
+	cairo_surface_write_to_png(surface, path);
+}
+
+
+/**
+ * Read the timing baselines, returns how many there are.
+ */
+static int
+load_baselines(struct baseline **baselines)
+{
+	FILE *fp;
+	int count = 0, size = 0;
+	struct baseline entry, *grown;
+
+	*baselines = NULL;
+
+	fp = fopen(CHECK_BASELINE, "r");
+	if (fp == NULL)
+		return 0;
+
+	while (fscanf(fp, "%63s %15s %lf", entry.name, entry.phase,
+	    &entry.seconds) == 3) {
+		if (count == size) {
+			size = size ? size * 2 : 32;
+			grown = realloc(*baselines,
+					sizeof(struct baseline) * size);
+			if (grown == NULL)
+				break;
+			*baselines = grown;
+		}
+		(*baselines)[count++] = entry;
+	}
+	fclose(fp);
+
+	return count;
+}
+
+
+static double
+find_baseline(struct baseline *baselines, int count, const char *name,
+		const char *phase)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (strcmp(baselines[i].name, name) == 0 &&
+		    strcmp(baselines[i].phase, phase) == 0)
+			return baselines[i].seconds;
+
+	return NAN;
+}
+
+
+/**
+ * Render a case of the corpus and check it. Returns the number of failures.
+ */
+static int
+run_case(const struct check_case *test, struct baseline *baselines,
+		int baselines_count, FILE *bless_fp)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	chq_dataplot_t *chart, *points;
+	double *x = NULL, *y = NULL, best[PHASE_COUNT], start, mid, end;
+	double *points_x = NULL, *points_y = NULL, baseline;
+	int i, phase, failures = 0;
+
+	chart = chq_dataplot_new();
+	chq_dataplot_set_width(chart, test->width);
+	chq_dataplot_set_height(chart, test->height);
+	test->setup(chart, &x, &y);
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			test->width, test->height);
+	cr = cairo_create(surface);
+
+	for (phase = 0; phase < PHASE_COUNT; phase++)
+		best[phase] = INFINITY;
+
+	for (i = 0; i < CHECK_RUNS; i++) {
+		cairo_save(cr);
+		cairo_set_source_rgb(cr, 1, 1, 1);
+		cairo_paint(cr);
+		cairo_restore(cr);
+
+		chart->cr = cr;
+		start = now();
+		chq_dataplot_render_axes(chart);
+		mid = now();
+		chq_dataplot_render_plots(chart);
+		end = now();
+
+		if (mid - start < best[PHASE_AXES])
+			best[PHASE_AXES] = mid - start;
+		if (end - mid < best[PHASE_DATA])
+			best[PHASE_DATA] = end - mid;
+	}
+
+	printf("%-16s", test->name);
+
+	if (check_sanity(chart, cr) == -1) {
+		printf(" FAIL");
+		failures++;
+	}
+
+	if (check_image(test->name, surface) == -1) {
+		printf(" FAIL");
+		write_failure(test->name, surface);
+		failures++;
+	}
+
+	points = chq_dataplot_new();
+	chq_dataplot_set_width(points, test->width);
+	chq_dataplot_set_height(points, test->height);
+	test->setup(points, &points_x, &points_y);
+	if (check_points(test->name, points) == -1) {
+		printf(" FAIL");
+		failures++;
+	}
+	chq_dataplot_kill(points);
+	free(points_x);
+	free(points_y);
+
+	for (phase = 0; phase < PHASE_COUNT; phase++) {
+		printf(" %s %.2fms", phase_names[phase], best[phase] * 1e3);
+		if (bless_fp != NULL) {
+			fprintf(bless_fp, "%s %s %.9f\n", test->name,
+			    phase_names[phase], best[phase]);
+			continue;
+		}
+		baseline = find_baseline(baselines, baselines_count,
+				test->name, phase_names[phase]);
+		if (isnan(baseline)) {
+			printf(" no baseline");
+			skipped++;
+			continue;
+		}
+		if (best[phase] > baseline * (1.0 + slower / 100.0) &&
+		    best[phase] - baseline > CHECK_NOISE) {
+			printf(" (%+.0f%%) SLOWER", (best[phase] / baseline -
+			    1.0) * 100.0);
+			failures++;
+		}
+	}
+	printf("\n");
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	chq_dataplot_kill(chart);
+	free(x);
+	free(y);
+
+	return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct baseline *baselines;
+	int ch, baselines_count, failures = 0;
+	size_t i;
+	FILE *bless_fp = NULL;
+	char *env;
+
+	while ((ch = getopt(argc, argv, "b")) != -1) {
+		switch (ch) {
+		case 'b':
+			bless = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: check [-b]\n");
+			return 1;
+		}
+	}
+
+	env = getenv("CHQ_CHECK_SLOWER");
+	if (env != NULL)
+		slower = strtod(env, NULL);
+
+	baselines_count = load_baselines(&baselines);
+	if (bless) {
+		bless_fp = fopen(CHECK_BASELINE, "w");
+		if (bless_fp == NULL) {
+			perror(CHECK_BASELINE);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++)
+		failures += run_case(&corpus[i], baselines, baselines_count,
+		    bless_fp);
+	failures += check_raster();
+	failures += check_columns();
+	failures += check_buffers();
+	failures += check_layout();
+	failures += check_pool();
+	failures += check_kernels();
+	failures += check_store();
+	failures += check_time();
+	failures += check_grid();
+	failures += check_csv();
+	failures += check_progressive();
+	failures += check_pick();
+	failures += check_vector();
+
+	if (bless_fp != NULL)
+		fclose(bless_fp);
+	free(baselines);
+
+	if (skipped > 0)
+		printf("%d comparison(s) skipped without a reference, see "
+		    "\"make bless\"\n", skipped);
+	if (failures > 0) {
+		printf("%d failure(s)\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
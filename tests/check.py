@@ -0,0 +1,170 @@
+# Checks of the chartesque Python module, run by "make check" once the
+# module is built ("make python"):
+#
+#  - contiguous float64 arrays are used in place: they cannot be resized
+#    while a chart holds them, and values written to them show up in the
+#    next render;
+#  - strided views and other types (int32) are copied: the source is left
+#    free, and the chart looks like one made from float64 copies;
+#  - render_into() refuses buffers that cannot hold the chart;
+#  - a chart being rendered refuses to be changed from another thread.
+#
+# Every check prints its name, followed by FAIL if it failed, and the exit
+# status is the number of failures.
+
+import array
+import math
+import sys
+import threading
+
+import chartesque
+
+WIDTH = 200
+HEIGHT = 150
+
+
+def wave(n):
+    return [math.sin(i * 12.0 / n) for i in range(n)]
+
+
+def make_chart(x, y):
+    chart = chartesque.Chart(WIDTH, HEIGHT)
+    chart.set_data(x, y)
+    chart.set_x_limit(0, len(x) - 1)
+    chart.set_y_limit(-1.2, 1.2)
+    return chart
+
+
+def render(chart):
+    pixels = bytearray(WIDTH * HEIGHT * 4)
+    chart.render_into(pixels)
+    return bytes(pixels)
+
+
+def resizable(a):
+    try:
+        a.append(0)
+    except BufferError:
+        return False
+    a.pop()
+    return True
+
+
+def check_shared():
+    x = array.array("d", range(500))
+    y = array.array("d", wave(500))
+    chart = make_chart(x, y)
+    if resizable(x) or resizable(y):
+        return "not held"
+
+    before = render(chart)
+    for i in range(len(y)):
+        y[i] = -y[i]
+    after = render(chart)
+    if after == before:
+        return "write not shown"
+    if after != render(make_chart(array.array("d", x),
+                                  array.array("d", y))):
+        return "not the written values"
+
+    del chart
+    if not resizable(x) or not resizable(y):
+        return "still held"
+    return None
+
+
+def check_copied():
+    values = wave(500)
+    reference = render(make_chart(array.array("d", range(500)),
+                                  array.array("d", values)))
+
+    x = array.array("d", [v for i in range(500) for v in (i, -1.0)])
+    y = array.array("d", [v for i in values for v in (i, 5.0)])
+    with memoryview(x) as mx, memoryview(y) as my:
+        chart = make_chart(mx[::2], my[::2])
+    if not resizable(x) or not resizable(y):
+        return "strided view held"
+    if render(chart) != reference:
+        return "strided view differs"
+
+    x = array.array("i", range(500))
+    chart = make_chart(x, array.array("d", values))
+    if not resizable(x):
+        return "int32 array held"
+    if render(chart) != reference:
+        return "int32 array differs"
+    return None
+
+
+def check_render_into():
+    chart = make_chart(array.array("d", range(10)),
+                       array.array("d", wave(10)))
+    stride = WIDTH * 4
+    bad = (
+        ((bytearray(stride * HEIGHT - 1),), {}),
+        ((bytearray(stride * HEIGHT),), {"stride": stride - 4}),
+        ((bytearray((stride + 2) * HEIGHT),), {"stride": stride + 2}),
+        ((bytearray((stride + 4) * HEIGHT - 1),), {"stride": stride + 4}),
+    )
+    for args, kwds in bad:
+        try:
+            chart.render_into(*args, **kwds)
+        except ValueError:
+            continue
+        return "accepted %d bytes, stride %s" % (len(args[0]),
+                                                kwds.get("stride"))
+    try:
+        chart.render_into(bytes(stride * HEIGHT))
+    except TypeError:
+        pass
+    else:
+        return "rendered into bytes"
+
+    chart.render_into(bytearray((stride + 4) * HEIGHT), stride=stride + 4)
+    return None
+
+
+def check_busy():
+    n = 4000000
+    chart = make_chart(array.array("d", range(n)),
+                       array.array("d", bytes(8 * n)))
+    started = threading.Event()
+
+    def run():
+        started.set()
+        chart.render_png()
+
+    refused = 0
+    thread = threading.Thread(target=run)
+    thread.start()
+    started.wait()
+    while thread.is_alive():
+        try:
+            chart.set_y_limit(-1.0, 1.0)
+        except RuntimeError:
+            refused += 1
+    thread.join()
+
+    if refused == 0:
+        return "never refused"
+    chart.set_y_limit(-1.2, 1.2)
+    return None
+
+
+def main():
+    failures = 0
+    for name, check in (("py_shared", check_shared),
+                        ("py_copied", check_copied),
+                        ("py_render_into", check_render_into),
+                        ("py_busy", check_busy)):
+        error = check()
+        line = "%-16s" % name
+        if error is not None:
+            line += " %s FAIL" % error
+            failures += 1
+        print(line)
+    return failures
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Ticks of time axes, whose values are seconds since the epoch (UTC). The
+ * ticks fall on round calendar values: the largest step from the table
+ * below that fits the number of ticks the axis has room for.
+ *
+ * The first tick is broken down into calendar fields once, the following
+ * ones are reached by stepping these fields, so there is no gmtime(3) or
+ * strftime(3) per tick. The first label is complete, the others only show
+ * the fields that changed since the previous tick (the date at midnight,
+ * the year in January, ...). Labels are numeric, so they do not depend on
+ * the locale.
+ *
+ * The labels are kept in a small cache for the current step, since most
+ * of them survive a scroll of the limits: a live chart redrawn at every
+ * new point formats only the ticks that just appeared.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chartesque.h"
+
+#define DAY	86400L
+
+enum time_field {
+	FIELD_YEAR,
+	FIELD_MONTH,
+	FIELD_DAY,
+	FIELD_MINUTE,
+	FIELD_SECOND
+};
+
+/* A complete label of each field, measured for the label sizes. */
+static const char *time_templates[CHQ_TIME_FIELDS] = {
+	"0000",
+	"0000-00",
+	"0000-00-00",
+	"0000-00-00 00:00",
+	"0000-00-00 00:00:00"
+};
+
+struct time_step {
+	long		 seconds;
+	int		 months;
+	enum time_field	 finest;
+};
+
+/* Steps that are not whole months are aligned on multiples from the epoch. */
+static const struct time_step time_steps[] = {
+	{ 1,		0,	FIELD_SECOND },
+	{ 2,		0,	FIELD_SECOND },
+	{ 5,		0,	FIELD_SECOND },
+	{ 10,		0,	FIELD_SECOND },
+	{ 15,		0,	FIELD_SECOND },
+	{ 30,		0,	FIELD_SECOND },
+	{ 60,		0,	FIELD_MINUTE },
+	{ 120,		0,	FIELD_MINUTE },
+	{ 300,		0,	FIELD_MINUTE },
+	{ 600,		0,	FIELD_MINUTE },
+	{ 900,		0,	FIELD_MINUTE },
+	{ 1800,		0,	FIELD_MINUTE },
+	{ 3600,		0,	FIELD_MINUTE },
+	{ 7200,		0,	FIELD_MINUTE },
+	{ 10800,	0,	FIELD_MINUTE },
+	{ 21600,	0,	FIELD_MINUTE },
+	{ 43200,	0,	FIELD_MINUTE },
+	{ DAY,		0,	FIELD_DAY },
+	{ 2 * DAY,	0,	FIELD_DAY },
+	{ 7 * DAY,	0,	FIELD_DAY },
+	{ 0,		1,	FIELD_MONTH },
+	{ 0,		3,	FIELD_MONTH },
+	{ 0,		6,	FIELD_MONTH },
+	{ 0,		12,	FIELD_YEAR },
+	{ 0,		24,	FIELD_YEAR },
+	{ 0,		60,	FIELD_YEAR },
+	{ 0,		120,	FIELD_YEAR },
+	{ 0,		240,	FIELD_YEAR },
+	{ 0,		600,	FIELD_YEAR },
+	{ 0,		1200,	FIELD_YEAR },
+};
+
+#define TIME_STEPS_COUNT	(sizeof(time_steps) / sizeof(time_steps[0]))
+
+static const struct time_step one_month = { 0, 1, FIELD_MONTH };
+
+/* Average month, only used to estimate the number of ticks. */
+#define MONTH_SECONDS		(30.436875 * DAY)
+
+struct time_fields {
+	long		 year;
+	int		 month;
+	int		 day;
+	int		 hour;
+	int		 minute;
+	int		 second;
+};
+
+static long	days_from_civil(long, int, int);
+static void	civil_from_days(long, long *, int *, int *);
+static int	days_in_month(long, int);
+static double	time_from_fields(const struct time_fields *);
+static void	time_to_fields(double, struct time_fields *);
+static double	time_advance(struct time_fields *, const struct time_step *);
+static char	*time_put(char *, long, int);
+static void	time_format(char *, const struct time_fields *,
+			const struct time_fields *, enum time_field);
+static int	time_pick_step(chq_axis_t *);
+static char	*time_cached_label(chq_axis_t *, char *, double,
+			const struct time_fields *, const struct time_fields *,
+			enum time_field);
+
+
+/*
+ * Days since 1970-01-01 of a date of the proleptic Gregorian calendar, and
+ * back (from http://howardhinnant.github.io/date_algorithms.html).
+ */
+static long
+days_from_civil(long y, int m, int d)
+{
+	long era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+
+static void
+civil_from_days(long z, long *y, int *m, int *d)
+{
+	long era, doe, yoe, doy, mp;
+
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+
+static int
+days_in_month(long year, int month)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31,
+		30, 31 };
+
+	if (month == 2 && year % 4 == 0 && (year % 100 != 0 ||
+	    year % 400 == 0))
+		return 29;
+	return days[month - 1];
+}
+
+
+static double
+time_from_fields(const struct time_fields *f)
+{
+	return (double)days_from_civil(f->year, f->month, f->day) * DAY +
+		f->hour * 3600 + f->minute * 60 + f->second;
+}
+
+
+static void
+time_to_fields(double t, struct time_fields *f)
+{
+	long days = floor(t / DAY);
+	long rest = t - (double)days * DAY;
+
+	civil_from_days(days, &f->year, &f->month, &f->day);
+	f->hour = rest / 3600;
+	f->minute = rest / 60 % 60;
+	f->second = rest % 60;
+}
+
+
+/**
+ * Move the fields by one step, returns the number of seconds they moved.
+ */
+static double
+time_advance(struct time_fields *f, const struct time_step *step)
+{
+	long seconds, days = 0;
+	int month;
+	double moved = 0.0;
+
+	if (step->months > 0) {
+		for (month = 0; month < step->months; month++) {
+			moved += days_in_month(f->year, f->month) * DAY;
+			if (++f->month > 12) {
+				f->month = 1;
+				f->year++;
+			}
+		}
+		return moved;
+	}
+
+	seconds = f->second + f->minute * 60L + f->hour * 3600L +
+		step->seconds;
+	days = seconds / DAY;
+	seconds %= DAY;
+	f->hour = seconds / 3600;
+	f->minute = seconds / 60 % 60;
+	f->second = seconds % 60;
+
+	while (days > 0) {
+		if (f->day + days <= days_in_month(f->year, f->month)) {
+			f->day += days;
+			break;
+		}
+		days -= days_in_month(f->year, f->month) - f->day + 1;
+		f->day = 1;
+		if (++f->month > 12) {
+			f->month = 1;
+			f->year++;
+		}
+	}
+
+	return step->seconds;
+}
+
+
+/**
+ * Write value on width digits, returns the end of the output.
+ */
+static char *
+time_put(char *p, long value, int width)
+{
+	int i;
+
+	if (value < 0 || (width == 4 && value > 9999))
+		return p + sprintf(p, "%0*ld", width, value);
+
+	for (i = width - 1; i >= 0; i--) {
+		p[i] = '0' + value % 10;
+		value /= 10;
+	}
+
+	return p + width;
+}
+
+
+/**
+ * Format the fields down to finest, starting with the coarsest one that
+ * changed since prev (everything if prev is NULL). The time of day is
+ * always complete, a changed date is shown with its month.
+ */
+static void
+time_format(char *p, const struct time_fields *f,
+		const struct time_fields *prev, enum time_field finest)
+{
+	int year = prev == NULL || prev->year != f->year;
+	int month = year || prev->month != f->month;
+	int day = month || prev->day != f->day;
+
+	switch (finest) {
+	case FIELD_YEAR:
+		p = time_put(p, f->year, 4);
+		break;
+	case FIELD_MONTH:
+		if (year) {
+			p = time_put(p, f->year, 4);
+			*p++ = '-';
+		}
+		p = time_put(p, f->month, 2);
+		break;
+	case FIELD_DAY:
+	case FIELD_MINUTE:
+	case FIELD_SECOND:
+		if (year) {
+			p = time_put(p, f->year, 4);
+			*p++ = '-';
+		}
+		if (month || (day && finest != FIELD_DAY)) {
+			p = time_put(p, f->month, 2);
+			*p++ = '-';
+		}
+		if (day || finest == FIELD_DAY)
+			p = time_put(p, f->day, 2);
+		if (finest == FIELD_DAY)
+			break;
+		if (day)
+			*p++ = ' ';
+		p = time_put(p, f->hour, 2);
+		*p++ = ':';
+		p = time_put(p, f->minute, 2);
+		if (finest == FIELD_SECOND) {
+			*p++ = ':';
+			p = time_put(p, f->second, 2);
+		}
+		break;
+	}
+
+	*p = '\0';
+}
+
+
+/**
+ * Index of the smallest step giving no more ticks than the axis has room
+ * for, spaced wide enough for their labels. -1 if the limits are too close
+ * for a one second step.
+ */
+static int
+time_pick_step(chq_axis_t *axis)
+{
+	chq_label_cache_t *cache = axis->label_cache;
+	double spread = chq_axis_get_spread(axis), seconds, width;
+	unsigned int i;
+
+	if (spread < 2.0)
+		return -1;
+
+	for (i = 0; i < TIME_STEPS_COUNT; i++) {
+		seconds = time_steps[i].months > 0 ?
+			time_steps[i].months * MONTH_SECONDS :
+			time_steps[i].seconds;
+		if (spread / seconds + 1.0 > axis->ticks_count)
+			continue;
+		/* Any tick may show a complete label. */
+		width = cache->label_widths[time_steps[i].finest] +
+			axis->label_padding * 2.0;
+		if (seconds * axis->size / spread >= width)
+			break;
+	}
+
+	return i < TIME_STEPS_COUNT ? (int)i : (int)TIME_STEPS_COUNT - 1;
+}
+
+
+/**
+ * Get the short label of a tick from the cache, formatting and caching it
+ * if needed. The cache only holds labels of the current step. Out of
+ * memory, the label is left uncached in buffer (MAX_LABEL_SIZE bytes).
+ */
+static char *
+time_cached_label(chq_axis_t *axis, char *buffer, double value,
+		const struct time_fields *f, const struct time_fields *prev,
+		enum time_field finest)
+{
+	chq_label_cache_t *cache = axis->label_cache;
+	unsigned int i;
+
+	for (i = 0; i < cache->len; i++)
+		if (cache->values[i] == value)
+			return cache->labels[i];
+
+	if (cache->len == CHQ_LABEL_CACHE_SIZE) {
+		for (i = 0; i < cache->len; i++)
+			free(cache->labels[i]);
+		cache->len = 0;
+	}
+
+	time_format(buffer, f, prev, finest);
+	cache->labels[cache->len] = strdup(buffer);
+	if (cache->labels[cache->len] == NULL)
+		return buffer;
+	cache->values[cache->len] = value;
+
+	return cache->labels[cache->len++];
+}
+
+
+/**
+ * Forget the cached labels.
+ */
+void
+chq_label_cache_kill(chq_label_cache_t *cache)
+{
+	unsigned int i;
+
+	if (cache == NULL)
+		return;
+	for (i = 0; i < cache->len; i++)
+		free(cache->labels[i]);
+	free(cache->font_family);
+	free(cache);
+}
+
+
+/**
+ * Make an axis show values as dates and times (CHQ_AXIS_TIME) or as plain
+ * numbers (CHQ_AXIS_LINEAR, the default).
+ */
+void
+chq_axis_set_type(chq_axis_t *axis, enum axis_type type)
+{
+	axis->type = type;
+	chq_label_cache_kill(axis->label_cache);
+	axis->label_cache = NULL;
+}
+
+
+/**
+ * Size the labels of a time axis from a complete label of each field, the
+ * steps are then picked so their labels fit. It is only measured again
+ * when the font changes.
+ */
+void
+chq_axis_time_calculate_label_size(chq_axis_t *axis, cairo_t *cr)
+{
+	chq_label_cache_t *cache = axis->label_cache;
+	unsigned int i;
+
+	if (cache == NULL) {
+		cache = calloc(1, sizeof(chq_label_cache_t));
+		if (cache == NULL)
+			return;
+		cache->step = -1;
+		axis->label_cache = cache;
+	}
+
+	if (cache->font_family == NULL ||
+	    cache->font_size != axis->label_fontsize ||
+	    strcmp(cache->font_family, axis->label_fontfamily) != 0) {
+		free(cache->font_family);
+		cache->font_family = strdup(axis->label_fontfamily);
+		cache->font_size = axis->label_fontsize;
+		for (i = 0; i < CHQ_TIME_FIELDS; i++)
+			chq_dataplot_get_text_size(cr, axis->label_fontfamily,
+					axis->label_slant, axis->label_weight,
+					axis->label_fontsize, time_templates[i],
+					&cache->label_widths[i],
+					&cache->label_height);
+	}
+
+	axis->label_max_width = cache->label_widths[FIELD_SECOND];
+	axis->label_max_height = cache->label_height;
+}
+
+
+/**
+ * Generate the ticks of a time axis, at most as many as chq_axis_set_size
+ * made room for. Returns -1 if the limits are too close for calendar
+ * ticks, the caller should then use plain ones.
+ */
+int
+chq_axis_time_prerender_ticks(chq_axis_t *axis)
+{
+	chq_label_cache_t *cache = axis->label_cache;
+	const struct time_step *step;
+	struct time_fields f, prev;
+	char buffer[MAX_LABEL_SIZE];
+	double value;
+	unsigned int i, count = 0;
+	int index;
+	long months;
+
+	if (cache == NULL)
+		return -1;
+	index = time_pick_step(axis);
+	if (index == -1)
+		return -1;
+	step = &time_steps[index];
+
+	if (cache->step != index) {
+		for (i = 0; i < cache->len; i++)
+			free(cache->labels[i]);
+		cache->len = 0;
+		cache->step = index;
+	}
+
+	/* First round value within the limits. */
+	if (step->months > 0) {
+		time_to_fields(axis->limit_min, &f);
+		f.day = 1;
+		f.hour = f.minute = f.second = 0;
+		value = time_from_fields(&f);
+		if (value < axis->limit_min)
+			value += time_advance(&f, &one_month);
+		months = f.year * 12 + f.month - 1;
+		while (months % step->months != 0) {
+			value += time_advance(&f, &one_month);
+			months++;
+		}
+	} else if (step->seconds == 7 * DAY) {
+		/* On Mondays, the epoch was a Thursday. */
+		value = ceil((axis->limit_min - 4 * DAY) / step->seconds) *
+			step->seconds + 4 * DAY;
+		time_to_fields(value, &f);
+	} else {
+		value = ceil(axis->limit_min / step->seconds) * step->seconds;
+		time_to_fields(value, &f);
+	}
+
+	for (; count < axis->ticks_count && value <= axis->limit_max;
+	    count++) {
+		axis->ticks_positions[count] = chq_axis_convert_to_scale(axis,
+				value);
+		free(axis->ticks_labels[count]);
+		if (count == 0) {
+			time_format(buffer, &f, NULL, step->finest);
+			axis->ticks_labels[count] = strdup(buffer);
+		} else {
+			axis->ticks_labels[count] = strdup(time_cached_label(
+			    axis, buffer, value, &f, &prev, step->finest));
+		}
+
+		prev = f;
+		value += time_advance(&f, step);
+	}
+
+	/* The arrays keep their size, the extra labels are all NULL. */
+	axis->ticks_count = count;
+	axis->ticks_value_spacing = step->months > 0 ?
+		step->months * MONTH_SECONDS : step->seconds;
+
+	return 0;
+}
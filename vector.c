@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2010, Bertrand Janin <tamentis@neopulsar.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cairo.h>
+#ifdef CAIRO_HAS_SVG_SURFACE
+#include <cairo-svg.h>
+#endif
+#ifdef CAIRO_HAS_PDF_SURFACE
+#include <cairo-pdf.h>
+#endif
+
+#include "chartesque.h"
+
+/* Coordinates are written with at most two decimals. */
+#define VECTOR_PRECISION	100.0
+
+static int	vector_render(chq_dataplot_t *, cairo_surface_t *);
+
+
+/**
+ * Render the chart on a vector surface and finish it. Labels are shown
+ * with cairo_show_text() instead of being filled as outlines, and the data
+ * coordinates are rounded, the chart settings are restored afterwards.
+ * Returns 0 on success, -1 if the surface could not be written.
+ */
+static int
+vector_render(chq_dataplot_t *chart, cairo_surface_t *surface)
+{
+	int labels_as_text = chart->labels_as_text;
+	double precision = chart->precision;
+	cairo_status_t status;
+	cairo_t *cr;
+
+	chart->labels_as_text = 1;
+	chart->precision = VECTOR_PRECISION;
+
+	cr = cairo_create(surface);
+	chq_dataplot_render(chart, cr);
+	cairo_destroy(cr);
+	cairo_surface_finish(surface);
+	status = cairo_surface_status(surface);
+	cairo_surface_destroy(surface);
+
+	chart->labels_as_text = labels_as_text;
+	chart->precision = precision;
+
+	return status == CAIRO_STATUS_SUCCESS ? 0 : -1;
+}
+
+
+/**
+ * Write the chart to an SVG file, sized in points. Cairo writes no text
+ * element in SVG: every glyph is defined once and the labels are made of
+ * references to them, which is smaller than an outline per label but
+ * cannot be selected or searched.
+ */
+int
+chq_dataplot_render_svg(chq_dataplot_t *chart, const char *path)
+{
+#ifdef CAIRO_HAS_SVG_SURFACE
+	return vector_render(chart, cairo_svg_surface_create(path,
+				chart->width, chart->height));
+#else
+	return -1;
+#endif
+}
+
+
+/**
+ * Write the chart to a PDF file, sized in points. The labels are real text
+ * in an embedded subset of their font.
+ */
+int
+chq_dataplot_render_pdf(chq_dataplot_t *chart, const char *path)
+{
+#ifdef CAIRO_HAS_PDF_SURFACE
+	return vector_render(chart, cairo_pdf_surface_create(path,
+				chart->width, chart->height));
+#else
+	return -1;
+#endif
+}